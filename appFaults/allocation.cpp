@@ -0,0 +1,636 @@
+/*+===================================================================
+  File:      allocation.cpp
+
+  Summary:   Allocation instrumentation for appFaults.exe and appFaultsHook.dll.
+             Replaces HeapAlloc, HeapReAlloc and HeapFree in the import address
+             tables, counts allocations per thread and writes the statistics to
+             %TEMP%\appFaults_alloc_<process ID>.txt
+
+  License: CC0
+  Copyright (c) 2024 codingABI
+
+===================================================================+*/
+
+#include "allocation.h"
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <intrin.h>
+#include <process.h>
+
+// Settings for the allocation instrumentation
+#define MAXALLOCTHREADS 256 // Running threads with own counters, slot 0 is shared by all further threads
+#define MAXSIZECLASSES 64 // Size class n counts allocations with 2^n...2^(n+1)-1 bytes
+#define MAXALLOCSAMPLES 16 // Sampled call sites per thread (ring buffer)
+#define MAXALLOCFRAMES 8 // Stack frames per sampled call site
+#define ALLOCSAMPLEBYTES (1024*1024) // Sample a call site every n allocated bytes
+#define ALLOCBENCHMARKLOOPS 1000000 // malloc/free pairs to measure the overhead
+#define ALLOCFILEINTERVAL_MS 1000 // Update interval for the statistics file
+#define MAXALLOCREPORTTHREADS 10 // Threads in the statistics
+#define MAXALLOCREPORTSAMPLES 5 // Call sites in the statistics
+
+// Sampled call site
+typedef struct {
+    PVOID pFrames[MAXALLOCFRAMES];
+    USHORT uFrames;
+} ALLOCSAMPLE;
+
+// Allocation counters for one thread. Counters are updated with interlocked functions (no locks, no torn
+// 64 bit values on x86), the sampled call sites only by the owner thread.
+// The slot of an ended thread is reused by a new thread, its counters are added to slot 0 before
+typedef struct {
+    volatile LONG lInUse; // 1 = Slot is owned by a running thread
+    volatile DWORD dwThreadId; // 0 = Slot is not shown in statistics
+    volatile LONG64 llAllocations;
+    volatile LONG64 llBytes;
+    volatile LONG64 llFrees;
+    volatile LONG64 llSizeClasses[MAXSIZECLASSES];
+    LONG64 llSampleCountdown; // Bytes until next sampled call site
+    volatile LONG lSamples; // Number of sampled call sites
+    ALLOCSAMPLE samples[MAXALLOCSAMPLES];
+} ALLOCTHREAD;
+
+// Consistent copy of the counters of one slot for the statistics
+typedef struct {
+    DWORD dwThreadId;
+    BOOL bShared; // TRUE = Slot 0
+    LONG64 llAllocations;
+    LONG64 llBytes;
+    LONG64 llFrees;
+} ALLOCSNAPSHOT;
+
+// Heap functions, that will be replaced in the import address tables
+typedef LPVOID (WINAPI* HEAPALLOCFUNCTION)(HANDLE, DWORD, SIZE_T);
+typedef LPVOID (WINAPI* HEAPREALLOCFUNCTION)(HANDLE, DWORD, LPVOID, SIZE_T);
+typedef BOOL (WINAPI* HEAPFREEFUNCTION)(HANDLE, DWORD, LPVOID);
+
+// Global variables
+BOOL g_allocInstrumentation = FALSE;
+ALLOCTHREAD g_allocThreads[MAXALLOCTHREADS];
+volatile LONG g_lAllocThreads = 0; // Highest used slot
+DWORD g_dwAllocFls = FLS_OUT_OF_INDEXES; // Releases the slot at thread end
+__declspec(thread) ALLOCTHREAD* t_pAllocThread = NULL;
+HEAPALLOCFUNCTION g_pHeapAlloc = NULL;
+HEAPREALLOCFUNCTION g_pHeapReAlloc = NULL;
+HEAPFREEFUNCTION g_pHeapFree = NULL;
+double g_dAllocCost = 0.0;
+double g_dAllocCostInstrumented = 0.0;
+std::wstring g_sAllocFile;
+LARGE_INTEGER g_liPerformanceFrequency;
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: LoadStringAsWstr
+
+  Summary:  Get resource string as wstring
+
+  Args:     HINSTANCE hInstance
+              Handle to instance module
+            UINT uID
+              Resource ID
+
+  Returns:  std::wstring
+
+-----------------------------------------------------------------F-F*/
+std::wstring LoadStringAsWstr(HINSTANCE hInstance, UINT uID) {
+    PCWSTR pws;
+    int cchStringLength = LoadStringW(hInstance, uID, reinterpret_cast<LPWSTR>(&pws), 0);
+    if (cchStringLength > 0) return std::wstring(pws, cchStringLength); else return std::wstring();
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: getNanoseconds
+
+  Summary:   Returns a high resolution timestamp
+
+  Args:
+
+  Returns:  ULONGLONG
+              Timestamp in nanoseconds
+
+-----------------------------------------------------------------F-F*/
+ULONGLONG getNanoseconds() {
+    LARGE_INTEGER liCounter;
+    QueryPerformanceCounter(&liCounter);
+    // Split calculation to prevent an overflow
+    return (liCounter.QuadPart / g_liPerformanceFrequency.QuadPart) * 1000000000ULL
+        + (liCounter.QuadPart % g_liPerformanceFrequency.QuadPart) * 1000000000ULL / g_liPerformanceFrequency.QuadPart;
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: releaseAllocThread
+
+  Summary:   Fiber local storage callback at thread end. Releases the
+             slot for a new thread, the counters are kept until then
+
+  Args:     PVOID data
+              Pointer to ALLOCTHREAD of the ending thread
+
+  Returns:
+
+-----------------------------------------------------------------F-F*/
+void WINAPI releaseAllocThread(PVOID data) {
+    ALLOCTHREAD* pThread = (ALLOCTHREAD*)data;
+    if (pThread == NULL) return;
+
+    // Allocations of DLL cleanups after this callback are counted in the shared slot
+    if (t_pAllocThread == pThread) t_pAllocThread = &g_allocThreads[0];
+    InterlockedExchange(&pThread->lInUse, 0);
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: getAllocThread
+
+  Summary:   Returns the allocation counters for the current thread.
+             A new thread gets its own slot, when slots are available.
+             The counters of an ended thread in a reused slot are added
+             to the shared slot 0
+
+  Args:
+
+  Returns:  ALLOCTHREAD*
+              Pointer to counters
+
+-----------------------------------------------------------------F-F*/
+ALLOCTHREAD* getAllocThread() {
+    if (t_pAllocThread != NULL) return t_pAllocThread;
+
+    t_pAllocThread = &g_allocThreads[0]; // Until a slot is found or when all slots are in use
+    for (LONG lSlot = 1; lSlot < MAXALLOCTHREADS; lSlot++) {
+        ALLOCTHREAD* pThread = &g_allocThreads[lSlot];
+        if ((pThread->lInUse != 0) || (InterlockedCompareExchange(&pThread->lInUse, 1, 0) != 0)) continue;
+
+        // Move counters of an ended thread to the shared slot, counters of hidden slots are dropped
+        ALLOCTHREAD* pShared = &g_allocThreads[0];
+        BOOL bEnded = (pThread->dwThreadId != 0);
+        pThread->dwThreadId = 0;
+        LONG64 llValue = InterlockedExchange64(&pThread->llAllocations, 0);
+        if (bEnded) InterlockedExchangeAdd64(&pShared->llAllocations, llValue);
+        llValue = InterlockedExchange64(&pThread->llBytes, 0);
+        if (bEnded) InterlockedExchangeAdd64(&pShared->llBytes, llValue);
+        llValue = InterlockedExchange64(&pThread->llFrees, 0);
+        if (bEnded) InterlockedExchangeAdd64(&pShared->llFrees, llValue);
+        for (int i = 0; i < MAXSIZECLASSES; i++) {
+            llValue = InterlockedExchange64(&pThread->llSizeClasses[i], 0);
+            if (bEnded) InterlockedExchangeAdd64(&pShared->llSizeClasses[i], llValue);
+        }
+        pThread->llSampleCountdown = 0;
+        pThread->lSamples = 0;
+        pThread->dwThreadId = GetCurrentThreadId();
+
+        LONG lUsed;
+        while ((lUsed = g_lAllocThreads) < lSlot) InterlockedCompareExchange(&g_lAllocThreads, lSlot, lUsed);
+
+        t_pAllocThread = pThread;
+        if (g_dwAllocFls != FLS_OUT_OF_INDEXES) FlsSetValue(g_dwAllocFls, pThread);
+        break;
+    }
+    return t_pAllocThread;
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: getSizeClass
+
+  Summary:   Returns the log2 size class for an allocation
+
+  Args:     SIZE_T size
+              Size in bytes
+
+  Returns:  int
+              Size class n for 2^n...2^(n+1)-1 bytes (0 and 1 byte are size class 0)
+
+-----------------------------------------------------------------F-F*/
+int getSizeClass(SIZE_T size) {
+    unsigned long ulIndex;
+#ifdef _WIN64
+    if (!_BitScanReverse64(&ulIndex, size)) return 0;
+#else
+    if (!_BitScanReverse(&ulIndex, size)) return 0;
+#endif
+    return (int)ulIndex;
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: countAllocation
+
+  Summary:   Counts an allocation for the current thread and samples the
+             call site every ALLOCSAMPLEBYTES bytes.
+             Must not be inlined, because the stack capture skips this function and the hook
+
+  Args:     SIZE_T size
+              Size in bytes
+
+  Returns:
+
+-----------------------------------------------------------------F-F*/
+__declspec(noinline) void countAllocation(SIZE_T size) {
+    ALLOCTHREAD* pThread = getAllocThread();
+    int iSizeClass = getSizeClass(size);
+
+    InterlockedIncrement64(&pThread->llAllocations);
+    InterlockedExchangeAdd64(&pThread->llBytes, (LONG64)size);
+    InterlockedIncrement64(&pThread->llSizeClasses[iSizeClass]);
+    if (pThread == &g_allocThreads[0]) return; // Shared slot has no samples
+
+    pThread->llSampleCountdown -= size;
+    if (pThread->llSampleCountdown <= 0) {
+        pThread->llSampleCountdown = ALLOCSAMPLEBYTES;
+        ALLOCSAMPLE* pSample = &pThread->samples[pThread->lSamples % MAXALLOCSAMPLES];
+        pSample->uFrames = CaptureStackBackTrace(2, MAXALLOCFRAMES, pSample->pFrames, NULL);
+        pThread->lSamples++;
+    }
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: countFree
+
+  Summary:   Counts a free for the current thread
+
+  Args:
+
+  Returns:
+
+-----------------------------------------------------------------F-F*/
+void countFree() {
+    InterlockedIncrement64(&getAllocThread()->llFrees);
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: hookHeapAlloc
+
+  Summary:   Replacement for HeapAlloc, that counts the allocation
+
+  Args:     HANDLE hHeap
+            DWORD dwFlags
+            SIZE_T dwBytes
+
+  Returns:  LPVOID
+              Pointer to allocated memory
+
+-----------------------------------------------------------------F-F*/
+LPVOID WINAPI hookHeapAlloc(HANDLE hHeap, DWORD dwFlags, SIZE_T dwBytes) {
+    LPVOID pMemory = g_pHeapAlloc(hHeap, dwFlags, dwBytes);
+    if (pMemory != NULL) countAllocation(dwBytes);
+    return pMemory;
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: hookHeapReAlloc
+
+  Summary:   Replacement for HeapReAlloc, that counts the reallocation as allocation and free
+
+  Args:     HANDLE hHeap
+            DWORD dwFlags
+            LPVOID lpMem
+            SIZE_T dwBytes
+
+  Returns:  LPVOID
+              Pointer to reallocated memory
+
+-----------------------------------------------------------------F-F*/
+LPVOID WINAPI hookHeapReAlloc(HANDLE hHeap, DWORD dwFlags, LPVOID lpMem, SIZE_T dwBytes) {
+    LPVOID pMemory = g_pHeapReAlloc(hHeap, dwFlags, lpMem, dwBytes);
+    if (pMemory != NULL) {
+        countAllocation(dwBytes);
+        countFree();
+    }
+    return pMemory;
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: hookHeapFree
+
+  Summary:   Replacement for HeapFree, that counts the free
+
+  Args:     HANDLE hHeap
+            DWORD dwFlags
+            LPVOID lpMem
+
+  Returns:  BOOL
+              TRUE = success
+
+-----------------------------------------------------------------F-F*/
+BOOL WINAPI hookHeapFree(HANDLE hHeap, DWORD dwFlags, LPVOID lpMem) {
+    BOOL bResult = g_pHeapFree(hHeap, dwFlags, lpMem);
+    if (bResult && (lpMem != NULL)) countFree();
+    return bResult;
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: patchImport
+
+  Summary:   Replaces a function in the import address table of a module
+
+  Args:     HMODULE hModule
+              Module with import address table
+            const char* szFunction
+              Name of imported function
+            PVOID pFunction
+              New function
+
+  Returns:  BOOL
+              TRUE = Function was found and replaced
+
+-----------------------------------------------------------------F-F*/
+BOOL patchImport(HMODULE hModule, const char* szFunction, PVOID pFunction) {
+    BYTE* pBase = (BYTE*)hModule;
+    PIMAGE_NT_HEADERS pNtHeaders = (PIMAGE_NT_HEADERS)(pBase + ((PIMAGE_DOS_HEADER)pBase)->e_lfanew);
+    IMAGE_DATA_DIRECTORY importDirectory = pNtHeaders->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_IMPORT];
+    if (importDirectory.VirtualAddress == 0) return FALSE;
+
+    BOOL bPatched = FALSE;
+    for (PIMAGE_IMPORT_DESCRIPTOR pImport = (PIMAGE_IMPORT_DESCRIPTOR)(pBase + importDirectory.VirtualAddress); pImport->Name != 0; pImport++) {
+        if (pImport->OriginalFirstThunk == 0) continue; // No function names
+        PIMAGE_THUNK_DATA pName = (PIMAGE_THUNK_DATA)(pBase + pImport->OriginalFirstThunk);
+        PIMAGE_THUNK_DATA pAddress = (PIMAGE_THUNK_DATA)(pBase + pImport->FirstThunk);
+        for (; pName->u1.AddressOfData != 0; pName++, pAddress++) {
+            if (IMAGE_SNAP_BY_ORDINAL(pName->u1.Ordinal)) continue;
+            PIMAGE_IMPORT_BY_NAME pByName = (PIMAGE_IMPORT_BY_NAME)(pBase + pName->u1.AddressOfData);
+            if (strcmp((const char*)pByName->Name, szFunction) != 0) continue;
+
+            DWORD dwProtect;
+            if (!VirtualProtect(&pAddress->u1.Function, sizeof(pAddress->u1.Function), PAGE_READWRITE, &dwProtect)) continue;
+            InterlockedExchangePointer((PVOID*)&pAddress->u1.Function, pFunction);
+            VirtualProtect(&pAddress->u1.Function, sizeof(pAddress->u1.Function), dwProtect, &dwProtect);
+            bPatched = TRUE;
+        }
+    }
+    return bPatched;
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: setAllocationHooks
+
+  Summary:   Installs or removes the heap hooks in the import address tables of
+             the program (static CRT in release builds), the module with this code
+             (appFaultsHook.dll), the dynamic CRT (debug builds) and the Windows CRT
+             msvcrt.dll (used by many other programs)
+
+  Args:     BOOL bInstall
+              TRUE = install hooks
+              FALSE = remove hooks
+
+  Returns:
+
+-----------------------------------------------------------------F-F*/
+void setAllocationHooks(BOOL bInstall) {
+    if (g_pHeapAlloc == NULL) {
+        HMODULE hKernel = GetModuleHandle(L"kernel32.dll");
+        if (hKernel == NULL) return;
+        *reinterpret_cast<FARPROC*>(&g_pHeapAlloc) = GetProcAddress(hKernel, "HeapAlloc");
+        *reinterpret_cast<FARPROC*>(&g_pHeapReAlloc) = GetProcAddress(hKernel, "HeapReAlloc");
+        *reinterpret_cast<FARPROC*>(&g_pHeapFree) = GetProcAddress(hKernel, "HeapFree");
+        if ((g_pHeapAlloc == NULL) || (g_pHeapReAlloc == NULL) || (g_pHeapFree == NULL)) {
+            g_pHeapAlloc = NULL;
+            return;
+        }
+    }
+
+    // Module with this code: appFaultsHook.dll has its own static CRT, that is used by the overhead measurement
+    HMODULE hSelf = NULL;
+    GetModuleHandleEx(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS | GET_MODULE_HANDLE_EX_FLAG_UNCHANGED_REFCOUNT, (LPCWSTR)&setAllocationHooks, &hSelf);
+
+    HMODULE hModules[] = { GetModuleHandle(NULL), hSelf, GetModuleHandle(L"ucrtbase.dll"), GetModuleHandle(L"ucrtbased.dll"), GetModuleHandle(L"msvcrt.dll") };
+    for (HMODULE hModule : hModules) {
+        if (hModule == NULL) continue;
+        patchImport(hModule, "HeapAlloc", bInstall ? (PVOID)&hookHeapAlloc : (PVOID)g_pHeapAlloc);
+        patchImport(hModule, "HeapReAlloc", bInstall ? (PVOID)&hookHeapReAlloc : (PVOID)g_pHeapReAlloc);
+        patchImport(hModule, "HeapFree", bInstall ? (PVOID)&hookHeapFree : (PVOID)g_pHeapFree);
+    }
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: threadAllocationBenchmark
+
+  Summary:   Measures the average time for malloc/free
+
+  Args:     void* data
+              Pointer to double for the result in nanoseconds
+
+  Returns:  unsigned int
+              0
+
+-----------------------------------------------------------------F-F*/
+unsigned int __stdcall threadAllocationBenchmark(void* data) {
+    ULONGLONG ullStart = getNanoseconds();
+    for (int i = 0; i < ALLOCBENCHMARKLOOPS; i++) {
+        void* volatile pMemory = malloc(64);
+        free(pMemory);
+    }
+    *(double*)data = (double)(getNanoseconds() - ullStart) / ALLOCBENCHMARKLOOPS;
+
+    // Allocations of the benchmark should not be shown in the statistics
+    if ((t_pAllocThread != NULL) && (t_pAllocThread != &g_allocThreads[0])) t_pAllocThread->dwThreadId = 0;
+    return 0;
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: measureAllocationCost
+
+  Summary:   Runs the malloc/free benchmark in a separate thread
+
+  Args:
+
+  Returns:  double
+              Average time for malloc/free in nanoseconds
+
+-----------------------------------------------------------------F-F*/
+double measureAllocationCost() {
+    double dCost = 0.0;
+    HANDLE hThread = (HANDLE)_beginthreadex(0, 0, &threadAllocationBenchmark, (void*)&dCost, 0, 0);
+    if (hThread != NULL) {
+        WaitForSingleObject(hThread, INFINITE);
+        CloseHandle(hThread);
+    }
+    return dCost;
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: formatAddress
+
+  Summary:   Format a code address as module+offset
+
+  Args:     PVOID pAddress
+              Code address
+
+  Returns:  std::wstring
+
+-----------------------------------------------------------------F-F*/
+std::wstring formatAddress(PVOID pAddress) {
+    #define MAXADDRESSLENGTH (MAX_PATH + 32)
+    wchar_t szAddress[MAXADDRESSLENGTH + 1];
+    wchar_t szModule[MAX_PATH];
+    HMODULE hModule = NULL;
+
+    if (GetModuleHandleEx(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS | GET_MODULE_HANDLE_EX_FLAG_UNCHANGED_REFCOUNT, (LPCWSTR)pAddress, &hModule)
+        && (GetModuleFileName(hModule, szModule, MAX_PATH) > 0)) {
+        const wchar_t* pszName = wcsrchr(szModule, L'\\');
+        _snwprintf_s(szAddress, MAXADDRESSLENGTH + 1, _TRUNCATE, L"%s+0x%llx",
+            (pszName != NULL) ? pszName + 1 : szModule,
+            (ULONGLONG)((BYTE*)pAddress - (BYTE*)hModule));
+    } else {
+        _snwprintf_s(szAddress, MAXADDRESSLENGTH + 1, _TRUNCATE, L"0x%p", pAddress);
+    }
+    return std::wstring(szAddress);
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: readAllocCounter
+
+  Summary:   Reads a counter, that is updated by another thread.
+             A plain read of a 64 bit value can be torn on x86
+
+  Args:     volatile LONG64* pCounter
+              Pointer to counter
+
+  Returns:  LONG64
+              Value of counter
+
+-----------------------------------------------------------------F-F*/
+LONG64 readAllocCounter(volatile LONG64* pCounter) {
+    return InterlockedCompareExchange64(pCounter, 0, 0);
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: getAllocationReport
+
+  Summary:   Returns the allocation statistics: Overhead, threads with most
+             allocated bytes, size classes and most sampled call sites
+
+  Args:
+
+  Returns:  std::wstring
+
+-----------------------------------------------------------------F-F*/
+std::wstring getAllocationReport() {
+    #define MAXALLOCLINELENGTH 255
+    wchar_t szLine[MAXALLOCLINELENGTH + 1];
+    std::wstring sReport;
+
+    _snwprintf_s(szLine, MAXALLOCLINELENGTH + 1, _TRUNCATE, LoadStringAsWstr(g_hInst, IDS_ALLOCOVERHEAD).c_str(), g_dAllocCost, g_dAllocCostInstrumented);
+    sReport.append(szLine).append(L"\n")
+        .append(LoadStringAsWstr(g_hInst, IDS_ALLOCFILE)).append(L"\n")
+        .append(g_sAllocFile).append(L"\n\n");
+
+    // Threads with most allocated bytes and sum of size classes and sampled call sites
+    std::vector<ALLOCSNAPSHOT> vThreads;
+    LONG64 llSizeClasses[MAXSIZECLASSES] = { 0 };
+    std::map<std::vector<PVOID>, int> mapSamples;
+    LONG lThreads = min(g_lAllocThreads + 1, MAXALLOCTHREADS);
+    for (LONG i = 0; i < lThreads; i++) {
+        ALLOCTHREAD* pThread = &g_allocThreads[i];
+        ALLOCSNAPSHOT snapshot;
+        snapshot.dwThreadId = pThread->dwThreadId;
+        if ((i > 0) && (snapshot.dwThreadId == 0)) continue; // Unused or hidden slot
+        snapshot.bShared = (i == 0);
+        snapshot.llAllocations = readAllocCounter(&pThread->llAllocations);
+        snapshot.llBytes = readAllocCounter(&pThread->llBytes);
+        snapshot.llFrees = readAllocCounter(&pThread->llFrees);
+        if (snapshot.llAllocations == 0) continue;
+        vThreads.push_back(snapshot);
+        for (int j = 0; j < MAXSIZECLASSES; j++) llSizeClasses[j] += readAllocCounter(&pThread->llSizeClasses[j]);
+        LONG lSamples = min(pThread->lSamples, MAXALLOCSAMPLES);
+        for (LONG j = 0; j < lSamples; j++) {
+            ALLOCSAMPLE* pSample = &pThread->samples[j];
+            mapSamples[std::vector<PVOID>(pSample->pFrames, pSample->pFrames + min(pSample->uFrames, MAXALLOCFRAMES))]++;
+        }
+    }
+
+    sReport.append(LoadStringAsWstr(g_hInst, IDS_ALLOCTHREADS)).append(L"\n");
+    std::sort(vThreads.begin(), vThreads.end(), [](const ALLOCSNAPSHOT& a, const ALLOCSNAPSHOT& b) { return a.llBytes > b.llBytes; });
+    for (size_t i = 0; (i < vThreads.size()) && (i < MAXALLOCREPORTTHREADS); i++) {
+        // Shared slot for threads without own slot is shown as *
+        std::wstring sThread(vThreads[i].bShared ? L"*" : std::to_wstring(vThreads[i].dwThreadId));
+        _snwprintf_s(szLine, MAXALLOCLINELENGTH + 1, _TRUNCATE, L"%s: %lli / %lli / %lli\n",
+            sThread.c_str(),
+            vThreads[i].llAllocations,
+            vThreads[i].llBytes,
+            vThreads[i].llFrees);
+        sReport.append(szLine);
+    }
+
+    sReport.append(L"\n").append(LoadStringAsWstr(g_hInst, IDS_ALLOCSIZES)).append(L"\n");
+    for (int i = 0; i < MAXSIZECLASSES; i++) {
+        if (llSizeClasses[i] == 0) continue;
+        _snwprintf_s(szLine, MAXALLOCLINELENGTH + 1, _TRUNCATE, L"%llu-%llu: %lli\n",
+            (i == 0) ? 0ULL : (1ULL << i), (i == 63) ? ~0ULL : (1ULL << (i + 1)) - 1, llSizeClasses[i]);
+        sReport.append(szLine);
+    }
+
+    sReport.append(L"\n").append(LoadStringAsWstr(g_hInst, IDS_ALLOCSAMPLES)).append(L"\n");
+    std::vector<std::pair<int, std::vector<PVOID>>> vSamples;
+    for (auto& sample : mapSamples) vSamples.push_back(std::make_pair(sample.second, sample.first));
+    std::sort(vSamples.begin(), vSamples.end(), [](const std::pair<int, std::vector<PVOID>>& a, const std::pair<int, std::vector<PVOID>>& b) { return a.first > b.first; });
+    for (size_t i = 0; (i < vSamples.size()) && (i < MAXALLOCREPORTSAMPLES); i++) {
+        sReport.append(std::to_wstring(vSamples[i].first)).append(L":");
+        for (PVOID pFrame : vSamples[i].second) sReport.append(L" ").append(formatAddress(pFrame));
+        sReport.append(L"\n");
+    }
+    return sReport;
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: threadAllocationFile
+
+  Summary:   Writes the allocation statistics periodically to a file.
+             The file is also updated, when the GUI is frozen by a fault
+
+  Args:     void* data
+              Unused
+
+  Returns:  unsigned int
+              0, but never returns
+
+-----------------------------------------------------------------F-F*/
+unsigned int __stdcall threadAllocationFile(void* data) {
+    while (true) {
+        Sleep(ALLOCFILEINTERVAL_MS);
+        if (!g_allocInstrumentation) continue;
+
+        std::wstring sReport(getAllocationReport());
+        int iLength = WideCharToMultiByte(CP_UTF8, 0, sReport.c_str(), (int)sReport.length(), NULL, 0, NULL, NULL);
+        std::string sUtf8(iLength, '\0');
+        WideCharToMultiByte(CP_UTF8, 0, sReport.c_str(), (int)sReport.length(), &sUtf8[0], iLength, NULL, NULL);
+
+        HANDLE hFile = CreateFile(g_sAllocFile.c_str(), GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (hFile == INVALID_HANDLE_VALUE) continue;
+        DWORD dwWritten;
+        WriteFile(hFile, sUtf8.c_str(), (DWORD)sUtf8.length(), &dwWritten, NULL);
+        CloseHandle(hFile);
+    }
+    return 0;
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: setAllocationInstrumentation
+
+  Summary:   Enables or disables the allocation instrumentation.
+             The overhead is measured when the instrumentation is enabled the first time
+
+  Args:     BOOL bEnable
+              TRUE = enable
+              FALSE = disable
+
+  Returns:
+
+-----------------------------------------------------------------F-F*/
+void setAllocationInstrumentation(BOOL bEnable) {
+    static BOOL bInitialized = FALSE;
+
+    if (bEnable && !bInitialized) {
+        g_dwAllocFls = FlsAlloc(&releaseAllocThread);
+        g_dAllocCost = measureAllocationCost();
+        setAllocationHooks(TRUE);
+        g_dAllocCostInstrumented = measureAllocationCost();
+
+        wchar_t szTempPath[MAX_PATH];
+        if (GetTempPath(MAX_PATH, szTempPath) == 0) szTempPath[0] = L'\0';
+        g_sAllocFile = std::wstring(szTempPath).append(L"appFaults_alloc_").append(std::to_wstring(GetCurrentProcessId())).append(L".txt");
+
+        HANDLE hThread = (HANDLE)_beginthreadex(0, 0, &threadAllocationFile, NULL, 0, 0);
+        if (hThread != NULL) CloseHandle(hThread);
+        bInitialized = TRUE;
+    } else {
+        setAllocationHooks(bEnable);
+    }
+    g_allocInstrumentation = bEnable;
+}
@@ -0,0 +1,34 @@
+/*+===================================================================
+  File:      allocation.h
+
+  Summary:   Declarations of the allocation instrumentation (allocation.cpp)
+             for appFaults.exe and appFaultsHook.dll.
+
+             The program or DLL defines g_hInst (module with the string resources)
+
+  License: CC0
+  Copyright (c) 2024 codingABI
+
+===================================================================+*/
+
+#pragma once
+
+#include "framework.h"
+#include "resource.h"
+#include <string>
+
+// Defined by the program or DLL
+extern HINSTANCE g_hInst;
+
+// Global variables
+extern BOOL g_allocInstrumentation;
+extern LARGE_INTEGER g_liPerformanceFrequency; // Must be set before getNanoseconds() is used
+
+// Helpers
+std::wstring LoadStringAsWstr(HINSTANCE hInstance, UINT uID);
+ULONGLONG getNanoseconds();
+
+// Allocation instrumentation
+double measureAllocationCost();
+std::wstring getAllocationReport();
+void setAllocationInstrumentation(BOOL bEnable);
@@ -20,21 +20,40 @@
   20240814, Add progress bar as a "GUI is alive" indicator
   20240816, Replace progress bar with clock
   20241215, Add option for RegisterApplicationRestart
+  20261019, Add priority inversion with measured wait times
+  20261019, Add option to run faults in a job object with resource limits
+  20261019, Add loopback network faults (connection churn, throughput, socket leak)
+  20261019, Add allocation instrumentation with per-thread counters and size classes
+  20261019, Add machine calibration and fault intensity in percent of capacity
+  20261019, Add seeded chaos mode with timer wheel and replayable event log
 
 ===================================================================+*/
 
 #include "framework.h"
 #include "resource.h"
 #include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <algorithm>
+#include <intrin.h>
+#include <math.h>
+#include <timeapi.h>
+#include <winsock2.h>
+#include <mswsock.h>
 #include <commctrl.h>
 #include <shellapi.h>
 #include <process.h>
 #include <ShellScalingApi.h>
+#include <tlhelp32.h>
+#include "allocation.h"
 
 // Add libs (for Visual Studio)
 #pragma comment(lib,"comctl32.lib")
 #pragma comment(lib,"shcore.lib")
 #pragma comment(lib,"Version.lib")
+#pragma comment(lib,"ws2_32.lib")
+#pragma comment(lib,"winmm.lib")
 
 // Struct for an automatically generated button
 typedef struct {
@@ -43,173 +62,3042 @@ typedef struct {
 } AUTOBUTTON;
 
 // List of automatically generated buttons
-#define MAXAUTOBUTTONS 11
+#define MAXAUTOBUTTONS 18
 AUTOBUTTON g_autoButtons[MAXAUTOBUTTONS] = {
     { (PVOID) IDM_LOOP,IDS_LOOP },
     { (PVOID) IDM_LOOPTHREAD,IDS_LOOPTHREAD},
+    { (PVOID) IDM_CPULOAD,IDS_CPULOAD },
     { (PVOID) IDM_DEADLOCK,IDS_DEADLOCK },
     { (PVOID) IDM_EXTERNALDEADLOCK,IDS_EXTERNALDEADLOCK },
+    { (PVOID) IDM_PRIORITYINVERSION,IDS_PRIORITYINVERSION },
     { (PVOID) IDM_LOCK10S,IDS_LOCK10S },
     { (PVOID) IDM_MEMORYLEAK,IDS_MEMORYLEAK },
+    { (PVOID) IDM_MEMORYBANDWIDTH,IDS_MEMORYBANDWIDTH },
     { (PVOID) IDM_HANDLELEAK,IDS_HANDLELEAK },
     { (PVOID) IDM_GDILEAK,IDS_GDILEAK },
     { (PVOID) IDM_THREADSPAM,IDS_THREADSPAM },
+    { (PVOID) IDM_NETCHURN,IDS_NETCHURN },
+    { (PVOID) IDM_NETTHROUGHPUT,IDS_NETTHROUGHPUT },
+    { (PVOID) IDM_SOCKETLEAK,IDS_SOCKETLEAK },
+    { (PVOID) IDM_CHAOS,IDS_CHAOS },
     { (PVOID) IDM_FREEINVALID,IDS_FREEINVALID },
     { (PVOID) IDM_NULLACCESS,IDS_NULLACCESS}
 };
 
+// Automatically generated buttons are arranged in columns
+#define AUTOBUTTONCOLUMNS 2
+#define AUTOBUTTONROWS ((MAXAUTOBUTTONS + AUTOBUTTONCOLUMNS - 1) / AUTOBUTTONCOLUMNS)
+
 // Windows size in 96 dpi
-#define WINDOWWIDTH_96DPI 400
-#define WINDOWHEIGHT_96DPI (50*MAXAUTOBUTTONS)
+#define WINDOWWIDTH_96DPI (400*AUTOBUTTONCOLUMNS)
+#define WINDOWHEIGHT_96DPI (50*AUTOBUTTONROWS + 60)
+
+// Lines of the metrics panel above the status bar
+#define METRICS_JOB 0
+#define METRICS_NETWORK 1
+#define METRICS_CHAOS 2
+#define MAXMETRICS 3
+
+// Window message from worker threads to show a result. wParam = Resource string ID for title, lParam = Pointer to new std::wstring with text
+#define WM_FAULTREPORT (WM_APP + 1)
+
+// Window message from the chaos scheduler to block the GUI thread. wParam = Duration in ms
+#define WM_CHAOSSTALL (WM_APP + 2)
+
+// Window message from the parent process to stop the chaos mode in a child process. Result: 1 = stopped, 0 = not running
+#define WM_CHAOSSTOP (WM_APP + 3)
+#define CHAOSSTOPTIMEOUT_MS 1000
+
+// Window message from the calibration thread. wParam = TRUE for a new calibration by the user, FALSE for the calibration at program start,
+// lParam = Pointer to new CALIBRATION with the result
+#define WM_CALIBRATIONDONE (WM_APP + 4)
+
+// Log-scale histogram for durations in nanoseconds (4 sub-buckets per power of two)
+#define MAXHISTOGRAMBUCKETS 252
+typedef struct {
+    volatile LONG64 llCount[MAXHISTOGRAMBUCKETS]; // Number of values per bucket
+    volatile LONG64 llTotal; // Number of all values
+    volatile LONG64 llMax; // Largest value
+} HISTOGRAM;
+
+// Lock types for the priority inversion fault
+#define PILOCK_CRITICALSECTION 0
+#define PILOCK_SRWLOCK 1
+#define PILOCK_MUTEX 2
+#define MAXPILOCKTYPES 3
+
+// Duration for each run of the priority inversion fault. A run ends after the min. duration,
+// when the high priority thread has enough samples, but at the latest after the max. duration
+#define PIMINDURATION_MS 5000
+#define PIMAXDURATION_MS 120000
+#define PIMINSAMPLES 25
+
+// Shared data for the threads of the priority inversion fault
+typedef struct {
+    int iLockType; // One of PILOCK_...
+    BOOL bCeiling; // TRUE = Low priority thread runs with high priority while it holds the lock (priority ceiling)
+    CRITICAL_SECTION cs;
+    SRWLOCK srw;
+    HANDLE hMutex;
+    volatile LONG lStop; // 1 = Threads should end
+    HISTOGRAM histogram; // Wait times of the high priority thread
+} PRIORITYINVERSION;
+
+// Limits for faults in a job object
+#define JOBCPURATE_PERCENT 50
+#define JOBMEMORYLIMIT_MB 1024
+#define JOBPROCESSLIMIT 32
+
+// Command line parameter to start a fault immediately (used for child processes in a job object)
+#define FAULTPARAMETER L"/fault:"
+
+// Modes for the loopback network fault
+#define NETMODE_CHURN 0 // Connect and close as fast as possible
+#define NETMODE_THROUGHPUT 1 // Send messages to an echo server
+#define NETMODE_SOCKETLEAK 2 // Connect and never close
+
+// Operations for the loopback network fault
+#define NETOP_ACCEPT 0
+#define NETOP_CONNECT 1
+#define NETOP_SERVERRECV 2
+#define NETOP_SERVERSEND 3
+#define NETOP_CLIENTSEND 4
+#define NETOP_CLIENTRECV 5
+
+// Settings for the loopback network fault
+#define NETACCEPTS 64 // Pending accepts of the server
+#define NETCLIENTS 64 // Concurrent connects in churn and socket leak mode
+#define NETTHROUGHPUTCLIENTS 8 // Connections in throughput mode
+#define NETBUFFERSIZE 65536 // Receive buffer per connection
+#define NETMAXBATCH 64 // Max. messages per send
+#define NETMAXMESSAGESIZE (1024*1024) // Max. bytes per message
+#define NETRETRY_MS 10 // Delay for retries of failed connects/accepts
+
+// Command line parameters for throughput mode
+#define NETMESSAGESIZEPARAMETER L"/netmessagesize:"
+#define NETBATCHPARAMETER L"/netbatch:"
+
+// Overlapped operation for one socket of the loopback network fault.
+// In throughput mode a connection has a send operation (owns the socket) and a receive operation,
+// so a receive is in progress while a send is in progress
+typedef struct NETOPERATION {
+    OVERLAPPED overlapped; // Must be the first member
+    int iOperation; // One of NETOP_...
+    SOCKET socket;
+    char* pBuffer; // Buffer with NETBUFFERSIZE bytes (only in throughput mode, not for client sends)
+    WSABUF buffers[NETMAXBATCH]; // Messages for one send in throughput mode
+    DWORD dwLength; // Send operation of client: Bytes of the batch. Receive operation of server: Received bytes waiting for the echo
+    DWORD dwDone; // Send operation of client: Bytes received for the echo
+    ULONGLONG ullStart; // Timestamp of the send for RTT
+    struct NETOPERATION* pPeer; // Other operation of the connection in throughput mode, NULL = none
+    BOOL bBusy; // Operation is in progress (throughput mode)
+    BOOL bClosing; // Send operation: Connection will be closed, when no operation is in progress (throughput mode)
+    char acceptBuffer[2 * (sizeof(SOCKADDR_IN) + 16)]; // Addresses for AcceptEx
+} NETOPERATION;
+
+// Data for the loopback network fault
+typedef struct {
+    int iMode; // One of NETMODE_...
+    HANDLE hPort; // IO completion port for all sockets
+    SOCKET listenSocket;
+    SOCKADDR_IN address; // Address of loopback server
+    LPFN_ACCEPTEX pAcceptEx;
+    LPFN_CONNECTEX pConnectEx;
+    char* pMessage; // Message for throughput mode
+    std::vector<NETOPERATION*> vIdle; // Accepts and connects that should be retried
+    std::set<NETOPERATION*> operations; // All operations, to cancel them after a stop
+    ULONGLONG ullLastRetry; // Timestamp of the last retry
+    volatile LONG64 llConnections; // Successful connects
+    volatile LONG64 llBytes; // Bytes received by clients
+    volatile LONG64 llOpenSockets; // Connected sockets
+    volatile LONG64 llPortErrors; // Errors caused by ephemeral port exhaustion
+    HISTOGRAM rtt; // Round trip times in throughput mode
+    volatile LONG lStop; // 1 = Network thread should end
+    volatile LONG lFinished; // 1 = Network thread has ended
+} NETWORK;
+
+// Command line parameter to enable the allocation instrumentation at program start
+#define ALLOCPARAMETER L"/allocinstrumentation"
+
+// Command line parameter to load the allocation instrumentation into another process
+#define ALLOCINJECTPARAMETER L"/allocinject:"
+#define ALLOCHOOKDLL L"appFaultsHook.dll" // Same directory as appFaults.exe
+#define ALLOCINJECTTIMEOUT_MS 10000 // Max. time for LoadLibrary in the other process
+
+// Settings for the calibration
+#define CALIBRATIONDURATION_MS 500 // Duration for each measurement
+#define MAXBANDWIDTHTHREADS 256 // Max. threads for memory bandwidth calibration and fault (one per core)
+#define BANDWIDTHTOTALBUFFERSIZE (256*1024*1024) // Source buffer of all threads together (same for destination)
+#define BANDWIDTHMINBUFFERSIZE (8*1024*1024) // Min. source and destination buffer per thread
+#define BANDWIDTHCHUNKSIZE (1024*1024) // Bytes per memcpy
+#define CALIBRATIONVERSION 2 // Cached calibrations with another version are measured again
+#define CALIBRATIONFILE L"calibration.ini" // Cache file in %LOCALAPPDATA%\appFaults
+#define CALIBRATIONSECTION L"Calibration"
+
+// Command line parameter for the fault intensity in percent (used for child processes in a job object)
+#define INTENSITYPARAMETER L"/intensity:"
+
+// Capacity of the machine
+typedef struct {
+    DWORD dwLogicalProcessors;
+    DWORD dwCores;
+    DWORD dwPackages;
+    DWORD dwNumaNodes;
+    double dAllocationsPerSecond; // malloc/free pairs per second (one thread)
+    double dBandwidth; // memcpy bytes per second (one thread per core)
+    double dThreadsPerSecond; // Created and finished threads per second
+    double dHandlesPerSecond; // Opened and closed handles per second
+} CALIBRATION;
+
+// Rate limit for faults with an intensity below 100%
+typedef struct {
+    double dRate; // Operations per second, 0 = unlimited
+    ULONGLONG ullStart; // Timestamp of first operation
+    ULONGLONG ullCount; // Number of operations
+} RATELIMIT;
+
+// Data for the memory bandwidth calibration
+typedef struct {
+    ULONGLONG ullEnd; // Timestamp for end of measurement
+    volatile LONG64 llBytes; // Copied bytes of all threads
+} BANDWIDTHMEASUREMENT;
+
+// Event types for the chaos mode
+#define CHAOS_CPUSPIKE 0 // Intensity = Busy threads
+#define CHAOS_UISTALL 1 // Intensity is unused
+#define CHAOS_HANDLEBURST 2 // Intensity = Leaked handles, duration is unused
+#define MAXCHAOSTYPES 3
+#define CHAOS_GENERATE MAXCHAOSTYPES // Internal event to generate the next events from the seed
+
+// Settings for the chaos mode
+#define CHAOSHORIZON_MS 600000 // Events are generated up to 10 minutes in advance
+#define CHAOSFILE L"chaos.ini" // Distributions in %LOCALAPPDATA%\appFaults
+#define CHAOSSECTION L"Chaos"
+#define MAXCHAOSLOGLINELENGTH 127
+
+// Command line parameters for the chaos mode
+#define CHAOSSEEDPARAMETER L"/chaosseed:"
+#define CHAOSREPLAYPARAMETER L"/chaosreplay:"
+
+// Hierarchical timer wheel with 1 ms ticks: 4 levels with 256 slots cover 2^32 ms (49 days)
+#define WHEELLEVELS 4
+#define WHEELSLOTBITS 8
+#define WHEELSLOTS (1 << WHEELSLOTBITS)
+#define WHEELMAXTICK 0xFFFFFFFFULL
+
+// Distribution for one chaos event type. Arrivals are a Poisson process, duration and intensity are uniform
+typedef struct {
+    LPCWSTR szName; // Name in event log and key prefix in chaos.ini
+    double dRate; // Events per second, 0 = disabled
+    DWORD dwMinDuration; // ms
+    DWORD dwMaxDuration;
+    DWORD dwMinIntensity; // Percent of logical processors for CPU spikes, handles for handle bursts
+    DWORD dwMaxIntensity;
+} CHAOSTYPE;
+
+// Pending chaos event
+typedef struct CHAOSEVENT {
+    struct CHAOSEVENT* pNext; // Next event in the same slot of the timer wheel
+    ULONGLONG ullTick; // Planned start in ms after start of chaos mode
+    ULONGLONG ullSequence; // Order for events with the same tick
+    int iType; // One of CHAOS_...
+    DWORD dwDuration; // ms
+    DWORD dwIntensity;
+} CHAOSEVENT;
+
+// Data for the chaos mode
+typedef struct {
+    ULONGLONG ullSeed;
+    ULONGLONG ullRandom; // State of the pseudo random number generator
+    ULONGLONG ullNextArrival[MAXCHAOSTYPES]; // Tick of the next generated event per type
+    ULONGLONG ullSequence; // Number of scheduled events
+    ULONGLONG ullTick; // Next tick of the timer wheel
+    CHAOSEVENT* pWheel[WHEELLEVELS][WHEELSLOTS]; // Level n holds events, that are due in the current 2^(8*(n+1)) ms block
+    HANDLE hLog; // Event log
+    std::wstring sLogFile;
+    volatile LONG lStop; // 1 = Scheduler thread should end
+    volatile LONG lFinished; // 1 = Scheduler thread has ended
+    volatile LONG64 llEvents; // Started events
+    volatile LONG64 llPending; // Events in the timer wheel
+    volatile LONG64 llMaxDelay; // Max. ms between planned and real start
+} CHAOS;
+
+// Global variables
+HINSTANCE g_hInst;
+int g_iFontHeight_96DPI = -12;
+HFONT g_hFont = NULL;
+HWND g_hStatusBar = NULL;
+HWND g_hMetrics = NULL;
+HFONT g_hMetricsFont = NULL;
+std::wstring g_sMetrics[MAXMETRICS];
+HANDLE g_semaphore = NULL;
+HWND g_hLastFocus = NULL;
+HWND g_hWnd = NULL;
+BOOL g_registeredForRestart = FALSE;
+volatile LONG g_lPriorityInversionRunning = 0;
+volatile LONG g_lMemoryBandwidthThreads = 0; // Running threads of the memory bandwidth load
+volatile LONG g_lMemoryBandwidthStop = 0; // 1 = Threads of the memory bandwidth load should end
+BOOL g_runFaultsInJob = FALSE;
+UINT g_uStartFault = 0;
+DWORD g_dwAllocInjectProcessId = 0;
+HANDLE g_hJob = NULL;
+BOOL g_jobCpuLimit = FALSE;
+volatile LONG g_lJobMemoryLimitHits = 0;
+volatile LONG g_lJobProcessLimitHits = 0;
+volatile LONG g_lJobAbnormalExits = 0;
+NETWORK* g_pNetwork = NULL;
+DWORD g_dwNetMessageSize = 16384;
+DWORD g_dwNetBatch = 8;
+CALIBRATION g_calibration;
+BOOL g_calibrationRunning = FALSE;
+std::vector<GROUP_AFFINITY> g_vCores; // Logical processors per core, interleaved over the NUMA nodes
+int g_iIntensityPercent = 100;
+CHAOSTYPE g_chaosTypes[MAXCHAOSTYPES] = {
+    { L"CpuSpike", 0.5, 100, 2000, 25, 100 },
+    { L"UiStall", 0.05, 500, 10000, 0, 0 },
+    { L"HandleBurst", 2.0, 0, 0, 100, 10000 }
+};
+CHAOS* g_pChaos = NULL;
+BOOL g_chaosSeed = FALSE;
+ULONGLONG g_ullChaosSeed = 0;
+std::wstring g_sChaosReplayFile;
+DWORD g_dwChaosChildProcessId = 0; // Child process with chaos mode in the job object
+
+// Function declarations
+ATOM                MyRegisterClass(HINSTANCE hInstance);
+BOOL                InitInstance(HINSTANCE, int);
+LRESULT CALLBACK    WndProc(HWND, UINT, WPARAM, LPARAM);
+
+ /*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+   Function: MyGetDpiForWindow
+
+   Summary:  Returns the current DPI value for a window
+
+   I had a problem with the built in GetDpiForWindow function.
+   When I use this function and run the program on Windows 2012R2 the program does not start and I will get the message
+   'Der Prozedureinsprungpunkt "GetDpiForWindow" wurde in der DLL "...exe" nicht gefunden. '
+   a.k.a. 'The procedure entry point "GetDpiForWindow" could not be located in the dynamic link library "...exe"'
+   My workaround is MyGetDpiForWindow
+   
+   Args:     WND hWindow
+               Handle to window
+
+   Returns:  UINT
+               DPI for window
+
+ -----------------------------------------------------------------F-F*/
+UINT MyGetDpiForWindow(HWND hWindow) {
+    UINT uDpi = 96; // Failback value, if GetDpiForWindow could not be used
+
+    HMODULE hDLL = GetModuleHandle(L"user32.dll");
+    if (hDLL == NULL)
+        return uDpi;
+
+    UINT(__stdcall * GetDpiForWindow)(HWND hwnd);
+    *reinterpret_cast<FARPROC*>(&GetDpiForWindow) = GetProcAddress(hDLL, "GetDpiForWindow");
+
+    if (GetDpiForWindow == nullptr)
+        return uDpi;
+    return(GetDpiForWindow(hWindow));
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: showProgramInformation
+
+  Summary:   Show program information message box
+
+  Args:     HWND hWindow
+              Handle to main window
+
+  Returns:
+
+-----------------------------------------------------------------F-F*/
+void showProgramInformation(HWND hWindow) {
+    std::wstring sTitle(LoadStringAsWstr(g_hInst, IDS_APP_TITLE));
+    wchar_t szExecutable[MAX_PATH];
+    GetModuleFileName(NULL, szExecutable, MAX_PATH);
+
+    DWORD  verHandle = 0;
+    UINT   size = 0;
+    LPBYTE lpBuffer = NULL;
+    DWORD  verSize = GetFileVersionInfoSize(szExecutable, NULL);
+
+    if (verSize != 0) {
+        BYTE* verData = new BYTE[verSize];
+
+        if (GetFileVersionInfo(szExecutable, verHandle, verSize, verData))
+        {
+            if (VerQueryValue(verData, L"\\", (VOID FAR * FAR*) & lpBuffer, &size)) {
+                if (size) {
+                    VS_FIXEDFILEINFO* verInfo = (VS_FIXEDFILEINFO*)lpBuffer;
+                    if (verInfo->dwSignature == 0xfeef04bd) {
+                        sTitle.append(L" ")
+                            .append(std::to_wstring((verInfo->dwFileVersionMS >> 16) & 0xffff))
+                            .append(L".")
+                            .append(std::to_wstring((verInfo->dwFileVersionMS >> 0) & 0xffff))
+                            .append(L".")
+                            .append(std::to_wstring((verInfo->dwFileVersionLS >> 16) & 0xffff))
+                            .append(L".")
+                            .append(std::to_wstring((verInfo->dwFileVersionLS >> 0) & 0xffff));
+                    }
+                }
+            }
+        }
+        delete[] verData;
+    }
+
+    MessageBox(hWindow, LoadStringAsWstr(g_hInst, IDS_PROGINFO).c_str(), sTitle.c_str(), MB_ICONINFORMATION | MB_OK);
+}
+
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: threadLoop
+
+  Summary:   Faulty thread functions, that runs an endless loop
+
+  Args:     void* data
+              Unused
+
+  Returns:  unsigned int
+              0, but never returns
+
+-----------------------------------------------------------------F-F*/
+unsigned int __stdcall threadLoop(void* data) {
+    while (true);
+    return 0;
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: threadWaitForever
+
+  Summary:   Faulty thread functions, that waits forever 
+
+  Args:     void* data
+              Unused
+
+  Returns:  unsigned int
+              0, but never returns
+
+-----------------------------------------------------------------F-F*/
+unsigned int __stdcall threadWaitForever(void* data) {
+    WaitForSingleObject(g_semaphore, INFINITE);
+    return 0;
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: spinNanoseconds
+
+  Summary:   Busy wait (consumes CPU time like real work)
+
+  Args:     ULONGLONG ullDuration
+              Duration in nanoseconds
+
+  Returns:
+
+-----------------------------------------------------------------F-F*/
+void spinNanoseconds(ULONGLONG ullDuration) {
+    ULONGLONG ullEnd = getNanoseconds() + ullDuration;
+    while (getNanoseconds() < ullEnd);
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: getHistogramBucket
+
+  Summary:   Returns the histogram bucket for a value.
+             Values 0...3 get their own bucket, larger values are
+             split in 4 buckets per power of two
+
+  Args:     ULONGLONG ullValue
+              Value
+
+  Returns:  int
+              Bucket index
+
+-----------------------------------------------------------------F-F*/
+int getHistogramBucket(ULONGLONG ullValue) {
+    if (ullValue < 4) return (int)ullValue;
+    int iMsb = 2;
+    while ((iMsb < 63) && ((ullValue >> (iMsb + 1)) != 0)) iMsb++;
+    return (iMsb - 1) * 4 + (int)((ullValue >> (iMsb - 2)) & 3);
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: getHistogramBucketLimit
+
+  Summary:   Returns the largest value for a histogram bucket
+
+  Args:     int iBucket
+              Bucket index
+
+  Returns:  ULONGLONG
+              Largest value in bucket
+
+-----------------------------------------------------------------F-F*/
+ULONGLONG getHistogramBucketLimit(int iBucket) {
+    if (iBucket < 4) return iBucket;
+    int iMsb = iBucket / 4 + 1;
+    return ((4ULL + (iBucket % 4)) << (iMsb - 2)) + (1ULL << (iMsb - 2)) - 1;
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: addHistogramValue
+
+  Summary:   Adds a value to a histogram (thread safe)
+
+  Args:     HISTOGRAM* pHistogram
+              Pointer to histogram
+            ULONGLONG ullValue
+              Value
+
+  Returns:
+
+-----------------------------------------------------------------F-F*/
+void addHistogramValue(HISTOGRAM* pHistogram, ULONGLONG ullValue) {
+    InterlockedIncrement64(&pHistogram->llCount[getHistogramBucket(ullValue)]);
+    InterlockedIncrement64(&pHistogram->llTotal);
+    LONG64 llMax = pHistogram->llMax;
+    while ((LONG64)ullValue > llMax) {
+        LONG64 llPrevious = InterlockedCompareExchange64(&pHistogram->llMax, (LONG64)ullValue, llMax);
+        if (llPrevious == llMax) break;
+        llMax = llPrevious;
+    }
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: getHistogramPercentile
+
+  Summary:   Returns the (approximated) percentile of all values in a histogram
+
+  Args:     HISTOGRAM* pHistogram
+              Pointer to histogram
+            double dPercent
+              Percentile 0...100
+
+  Returns:  ULONGLONG
+              Upper limit of the bucket that contains the percentile
+              0 = no values
+
+-----------------------------------------------------------------F-F*/
+ULONGLONG getHistogramPercentile(HISTOGRAM* pHistogram, double dPercent) {
+    LONG64 llTotal = pHistogram->llTotal;
+    if (llTotal == 0) return 0;
+    LONG64 llRank = (LONG64)(dPercent * llTotal / 100.0 + 0.5);
+    if (llRank < 1) llRank = 1;
+    LONG64 llCount = 0;
+    for (int i = 0; i < MAXHISTOGRAMBUCKETS; i++) {
+        llCount += pHistogram->llCount[i];
+        if (llCount >= llRank) {
+            ULONGLONG ullLimit = getHistogramBucketLimit(i);
+            return (ullLimit < (ULONGLONG)pHistogram->llMax) ? ullLimit : (ULONGLONG)pHistogram->llMax;
+        }
+    }
+    return (ULONGLONG)pHistogram->llMax;
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: formatNanoseconds
+
+  Summary:   Format a duration with a matching unit (ns, us, ms, s)
+
+  Args:     ULONGLONG ullDuration
+              Duration in nanoseconds
+
+  Returns:  std::wstring
+
+-----------------------------------------------------------------F-F*/
+std::wstring formatNanoseconds(ULONGLONG ullDuration) {
+    #define MAXDURATIONLENGTH 31
+    wchar_t szDuration[MAXDURATIONLENGTH + 1];
+    if (ullDuration < 1000ULL)
+        _snwprintf_s(szDuration, MAXDURATIONLENGTH + 1, _TRUNCATE, L"%llu ns", ullDuration);
+    else if (ullDuration < 1000000ULL)
+        _snwprintf_s(szDuration, MAXDURATIONLENGTH + 1, _TRUNCATE, L"%.1f \u00b5s", ullDuration / 1000.0);
+    else if (ullDuration < 1000000000ULL)
+        _snwprintf_s(szDuration, MAXDURATIONLENGTH + 1, _TRUNCATE, L"%.1f ms", ullDuration / 1000000.0);
+    else
+        _snwprintf_s(szDuration, MAXDURATIONLENGTH + 1, _TRUNCATE, L"%.2f s", ullDuration / 1000000000.0);
+    return std::wstring(szDuration);
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: lockPriorityInversion
+
+  Summary:   Acquires the lock of the priority inversion fault
+
+  Args:     PRIORITYINVERSION* pInversion
+              Pointer to shared data
+
+  Returns:
+
+-----------------------------------------------------------------F-F*/
+void lockPriorityInversion(PRIORITYINVERSION* pInversion) {
+    switch (pInversion->iLockType) {
+        case PILOCK_CRITICALSECTION:
+            EnterCriticalSection(&pInversion->cs);
+            break;
+        case PILOCK_SRWLOCK:
+            AcquireSRWLockExclusive(&pInversion->srw);
+            break;
+        case PILOCK_MUTEX:
+            WaitForSingleObject(pInversion->hMutex, INFINITE);
+            break;
+    }
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: unlockPriorityInversion
+
+  Summary:   Releases the lock of the priority inversion fault
+
+  Args:     PRIORITYINVERSION* pInversion
+              Pointer to shared data
+
+  Returns:
+
+-----------------------------------------------------------------F-F*/
+void unlockPriorityInversion(PRIORITYINVERSION* pInversion) {
+    switch (pInversion->iLockType) {
+        case PILOCK_CRITICALSECTION:
+            LeaveCriticalSection(&pInversion->cs);
+            break;
+        case PILOCK_SRWLOCK:
+            ReleaseSRWLockExclusive(&pInversion->srw);
+            break;
+        case PILOCK_MUTEX:
+            ReleaseMutex(pInversion->hMutex);
+            break;
+    }
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: threadPriorityInversionLow
+
+  Summary:   Low priority thread, that holds the lock most of the time.
+             With priority ceiling the thread raises its priority to the priority
+             of the high priority thread, before it acquires the lock
+
+  Args:     void* data
+              Pointer to PRIORITYINVERSION
+
+  Returns:  unsigned int
+              0
+
+-----------------------------------------------------------------F-F*/
+unsigned int __stdcall threadPriorityInversionLow(void* data) {
+    PRIORITYINVERSION* pInversion = (PRIORITYINVERSION*)data;
+    while (!pInversion->lStop) {
+        if (pInversion->bCeiling) SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_HIGHEST);
+        lockPriorityInversion(pInversion);
+        spinNanoseconds(1000000ULL); // 1 ms "work" while holding the lock
+        unlockPriorityInversion(pInversion);
+        if (pInversion->bCeiling) SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_LOWEST);
+        spinNanoseconds(100000ULL); // 0.1 ms "work" without the lock
+    }
+    return 0;
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: threadPriorityInversionMedium
+
+  Summary:   Medium priority thread, that consumes CPU time without using the lock
+
+  Args:     void* data
+              Pointer to PRIORITYINVERSION
+
+  Returns:  unsigned int
+              0
+
+-----------------------------------------------------------------F-F*/
+unsigned int __stdcall threadPriorityInversionMedium(void* data) {
+    PRIORITYINVERSION* pInversion = (PRIORITYINVERSION*)data;
+    while (!pInversion->lStop);
+    return 0;
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: threadPriorityInversionHigh
+
+  Summary:   High priority thread, that periodically needs the lock and
+             measures how long it has to wait
+
+  Args:     void* data
+              Pointer to PRIORITYINVERSION
+
+  Returns:  unsigned int
+              0
+
+-----------------------------------------------------------------F-F*/
+unsigned int __stdcall threadPriorityInversionHigh(void* data) {
+    PRIORITYINVERSION* pInversion = (PRIORITYINVERSION*)data;
+    while (!pInversion->lStop) {
+        Sleep(5);
+        ULONGLONG ullStart = getNanoseconds();
+        lockPriorityInversion(pInversion);
+        ULONGLONG ullWait = getNanoseconds() - ullStart;
+        unlockPriorityInversion(pInversion);
+        addHistogramValue(&pInversion->histogram, ullWait);
+    }
+    return 0;
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: startThreadWithPriority
+
+  Summary:   Starts a thread with a given thread priority
+
+  Args:     unsigned int (__stdcall* pThreadFunction)(void*)
+              Thread function
+            void* data
+              Argument for thread function
+            int iPriority
+              Thread priority, like THREAD_PRIORITY_LOWEST
+
+  Returns:  HANDLE
+              Handle to thread
+              NULL = error
+
+-----------------------------------------------------------------F-F*/
+HANDLE startThreadWithPriority(unsigned int (__stdcall* pThreadFunction)(void*), void* data, int iPriority) {
+    HANDLE hThread = (HANDLE)_beginthreadex(0, 0, pThreadFunction, data, CREATE_SUSPENDED, 0);
+    if (hThread == NULL) return NULL;
+    SetThreadPriority(hThread, iPriority);
+    ResumeThread(hThread);
+    return hThread;
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: runPriorityInversion
+
+  Summary:   Runs the priority inversion fault for one lock type:
+             A low priority thread holds a lock, one medium priority thread per
+             logical processor consumes all CPU time and a high priority thread
+             waits for the lock
+
+  Args:     int iLockType
+              One of PILOCK_...
+            BOOL bCeiling
+              TRUE = Low priority thread uses priority ceiling (baseline)
+            DWORD dwProcessors
+              Number of medium priority threads
+
+  Returns:  std::wstring
+              Wait times of the high priority thread (p50/p90/p99/max, samples)
+
+-----------------------------------------------------------------F-F*/
+std::wstring runPriorityInversion(int iLockType, BOOL bCeiling, DWORD dwProcessors) {
+    PRIORITYINVERSION* pInversion = new PRIORITYINVERSION();
+    pInversion->iLockType = iLockType;
+    pInversion->bCeiling = bCeiling;
+    InitializeCriticalSection(&pInversion->cs);
+    InitializeSRWLock(&pInversion->srw);
+    pInversion->hMutex = CreateMutex(NULL, FALSE, NULL);
+
+    HANDLE* phThreads = new HANDLE[dwProcessors + 2];
+    DWORD dwThreads = 0;
+    HANDLE hThread = startThreadWithPriority(&threadPriorityInversionLow, pInversion, THREAD_PRIORITY_LOWEST);
+    if (hThread != NULL) phThreads[dwThreads++] = hThread;
+    Sleep(10); // Let the low priority thread get the lock before the CPU is flooded
+    for (DWORD i = 0; i < dwProcessors; i++) {
+        hThread = startThreadWithPriority(&threadPriorityInversionMedium, pInversion, THREAD_PRIORITY_NORMAL);
+        if (hThread != NULL) phThreads[dwThreads++] = hThread;
+    }
+    hThread = startThreadWithPriority(&threadPriorityInversionHigh, pInversion, THREAD_PRIORITY_HIGHEST);
+    if (hThread != NULL) phThreads[dwThreads++] = hThread;
+
+    // An inversion takes seconds, so a fixed duration would give only a few samples
+    ULONGLONG ullStart = GetTickCount64();
+    while (true) {
+        Sleep(100);
+        ULONGLONG ullElapsed = GetTickCount64() - ullStart;
+        if (ullElapsed >= PIMAXDURATION_MS) break;
+        if ((ullElapsed >= PIMINDURATION_MS) && (pInversion->histogram.llTotal >= PIMINSAMPLES)) break;
+    }
+
+    // Stop and wait for all threads (WaitForMultipleObjects is limited to 64 handles)
+    InterlockedExchange(&pInversion->lStop, 1);
+    for (DWORD i = 0; i < dwThreads; i++) {
+        WaitForSingleObject(phThreads[i], INFINITE);
+        CloseHandle(phThreads[i]);
+    }
+    delete[] phThreads;
+
+    std::wstring sResult(formatNanoseconds(getHistogramPercentile(&pInversion->histogram, 50)));
+    sResult.append(L" / ")
+        .append(formatNanoseconds(getHistogramPercentile(&pInversion->histogram, 90)))
+        .append(L" / ")
+        .append(formatNanoseconds(getHistogramPercentile(&pInversion->histogram, 99)))
+        .append(L" / ")
+        .append(formatNanoseconds((ULONGLONG)pInversion->histogram.llMax))
+        .append(L", ")
+        .append(std::to_wstring(pInversion->histogram.llTotal));
+
+    CloseHandle(pInversion->hMutex);
+    DeleteCriticalSection(&pInversion->cs);
+    delete pInversion;
+    return sResult;
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: threadPriorityInversion
+
+  Summary:   Runs the priority inversion fault for every lock type, followed by
+             a baseline with priority ceiling. The wait times of the high priority
+             thread are sent as WM_FAULTREPORT to the main window
+
+  Args:     void* data
+              Handle to main window
+
+  Returns:  unsigned int
+              0
+
+-----------------------------------------------------------------F-F*/
+unsigned int __stdcall threadPriorityInversion(void* data) {
+    HWND hWindow = (HWND)data;
+    const wchar_t* szLockNames[MAXPILOCKTYPES] = { L"CRITICAL_SECTION", L"SRWLOCK", L"Mutex" };
+    // dwNumberOfProcessors of GetSystemInfo counts only the processor group of the process
+    DWORD dwProcessors = GetActiveProcessorCount(ALL_PROCESSOR_GROUPS);
+
+    std::wstring sReport(LoadStringAsWstr(g_hInst, IDS_PRIORITYINVERSIONRESULT));
+    sReport.append(L"\n");
+
+    for (int iLockType = 0; iLockType < MAXPILOCKTYPES; iLockType++) {
+        sReport.append(L"\n")
+            .append(szLockNames[iLockType])
+            .append(L": ")
+            .append(runPriorityInversion(iLockType, FALSE, dwProcessors));
+        sReport.append(L"\n")
+            .append(szLockNames[iLockType])
+            .append(L" (")
+            .append(LoadStringAsWstr(g_hInst, IDS_PRIORITYCEILING))
+            .append(L"): ")
+            .append(runPriorityInversion(iLockType, TRUE, dwProcessors));
+    }
+    sReport.append(L"\n\n").append(LoadStringAsWstr(g_hInst, IDS_PRIORITYINVERSIONNOTE));
+
+    PostMessage(hWindow, WM_FAULTREPORT, IDS_PRIORITYINVERSION, (LPARAM)new std::wstring(sReport));
+    InterlockedExchange(&g_lPriorityInversionRunning, 0);
+    return 0;
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: isAutoButton
+
+  Summary:   Checks if an ID belongs to an automatically generated (fault) button
+
+  Args:     UINT uID
+              Resource ID
+
+  Returns:  BOOL
+              TRUE = ID is a fault button
+
+-----------------------------------------------------------------F-F*/
+BOOL isAutoButton(UINT uID) {
+    for (int i = 0; i < MAXAUTOBUTTONS; i++) {
+        if ((UINT)(ULONG_PTR)g_autoButtons[i].dwResourceID == uID) return TRUE;
+    }
+    return FALSE;
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: threadJobNotifications
+
+  Summary:   Counts limit violations and crashes reported by the job object
+
+  Args:     void* data
+              Handle to completion port of job object
+
+  Returns:  unsigned int
+              0, when completion port was closed
+
+-----------------------------------------------------------------F-F*/
+unsigned int __stdcall threadJobNotifications(void* data) {
+    HANDLE hPort = (HANDLE)data;
+    DWORD dwMessage;
+    ULONG_PTR ulKey;
+    LPOVERLAPPED pOverlapped;
+
+    while (GetQueuedCompletionStatus(hPort, &dwMessage, &ulKey, &pOverlapped, INFINITE)) {
+        switch (dwMessage) {
+            case JOB_OBJECT_MSG_JOB_MEMORY_LIMIT:
+                InterlockedIncrement(&g_lJobMemoryLimitHits);
+                break;
+            case JOB_OBJECT_MSG_ACTIVE_PROCESS_LIMIT:
+                InterlockedIncrement(&g_lJobProcessLimitHits);
+                break;
+            case JOB_OBJECT_MSG_ABNORMAL_EXIT_PROCESS:
+                InterlockedIncrement(&g_lJobAbnormalExits);
+                break;
+        }
+    }
+    return 0;
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: createFaultJob
+
+  Summary:   Creates the job object for faults (once) with limits for
+             CPU rate, job memory and number of active processes.
+             The CPU rate limit is optional, because it needs Windows 8/2012 or newer
+
+  Args:
+
+  Returns:  BOOL
+              TRUE = success
+              FALSE = error
+
+-----------------------------------------------------------------F-F*/
+BOOL createFaultJob() {
+    if (g_hJob != NULL) return TRUE;
+
+    HANDLE hJob = CreateJobObject(NULL, NULL);
+    if (hJob == NULL) return FALSE;
+
+    // Memory and process limits. Closing the job handle kills all faults
+    JOBOBJECT_EXTENDED_LIMIT_INFORMATION limits;
+    ZeroMemory(&limits, sizeof(limits));
+    limits.BasicLimitInformation.LimitFlags = JOB_OBJECT_LIMIT_JOB_MEMORY | JOB_OBJECT_LIMIT_ACTIVE_PROCESS | JOB_OBJECT_LIMIT_KILL_ON_JOB_CLOSE;
+    limits.BasicLimitInformation.ActiveProcessLimit = JOBPROCESSLIMIT;
+    limits.JobMemoryLimit = (SIZE_T)JOBMEMORYLIMIT_MB * 1024 * 1024;
+    if (!SetInformationJobObject(hJob, JobObjectExtendedLimitInformation, &limits, sizeof(limits))) {
+        CloseHandle(hJob);
+        return FALSE;
+    }
+
+    // CPU rate as hard cap in 1/100 percent of all processors
+    JOBOBJECT_CPU_RATE_CONTROL_INFORMATION cpuRate;
+    ZeroMemory(&cpuRate, sizeof(cpuRate));
+    cpuRate.ControlFlags = JOB_OBJECT_CPU_RATE_CONTROL_ENABLE | JOB_OBJECT_CPU_RATE_CONTROL_HARD_CAP;
+    cpuRate.CpuRate = JOBCPURATE_PERCENT * 100;
+    g_jobCpuLimit = SetInformationJobObject(hJob, JobObjectCpuRateControlInformation, &cpuRate, sizeof(cpuRate));
+
+    // Completion port to get notifications about limit violations
+    HANDLE hPort = CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, 1);
+    if (hPort != NULL) {
+        JOBOBJECT_ASSOCIATE_COMPLETION_PORT port;
+        port.CompletionKey = hJob;
+        port.CompletionPort = hPort;
+        HANDLE hThread = NULL;
+        if (SetInformationJobObject(hJob, JobObjectAssociateCompletionPortInformation, &port, sizeof(port)))
+            hThread = (HANDLE)_beginthreadex(0, 0, &threadJobNotifications, (void*)hPort, 0, 0);
+        if (hThread != NULL) CloseHandle(hThread); else CloseHandle(hPort);
+    }
+
+    g_hJob = hJob;
+    return TRUE;
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: startFaultInJob
+
+  Summary:   Starts a fault in a new child process in the job object.
+             When the job object could not be used, the child process
+             runs without limits. When the process limit of the job
+             is reached, Windows terminates the child process
+
+  Args:     UINT uFault
+              Resource ID of fault button
+
+  Returns:  DWORD
+              Process ID of child process
+              0 = error
+
+-----------------------------------------------------------------F-F*/
+DWORD startFaultInJob(UINT uFault) {
+    STARTUPINFO si;
+    PROCESS_INFORMATION pi;
+    wchar_t szExecutable[MAX_PATH];
+    GetModuleFileName(NULL, szExecutable, MAX_PATH);
+
+    std::wstring sCommand(L"\"");
+    sCommand.append(szExecutable)
+        .append(L"\" ")
+        .append(FAULTPARAMETER)
+        .append(std::to_wstring(uFault))
+        .append(L" ").append(NETMESSAGESIZEPARAMETER).append(std::to_wstring(g_dwNetMessageSize))
+        .append(L" ").append(NETBATCHPARAMETER).append(std::to_wstring(g_dwNetBatch))
+        .append(L" ").append(INTENSITYPARAMETER).append(std::to_wstring(g_iIntensityPercent));
+    if (g_allocInstrumentation) sCommand.append(L" ").append(ALLOCPARAMETER);
+    if (g_chaosSeed) sCommand.append(L" ").append(CHAOSSEEDPARAMETER).append(std::to_wstring(g_ullChaosSeed));
+    if (!g_sChaosReplayFile.empty()) sCommand.append(L" \"").append(CHAOSREPLAYPARAMETER).append(g_sChaosReplayFile).append(L"\"");
+
+    ZeroMemory(&si, sizeof(si));
+    si.cb = sizeof(si);
+    ZeroMemory(&pi, sizeof(pi));
+
+    // Start suspended, so the fault cannot run before the process is in the job
+    if (!CreateProcess(NULL, &sCommand[0], NULL, NULL, FALSE, CREATE_SUSPENDED, NULL, NULL, &si, &pi)) return 0;
+
+    if (!createFaultJob()) {
+        // For example nested jobs are not supported before Windows 8/2012
+        SendMessage(g_hStatusBar, SB_SETTEXT, 0, (LPARAM)LoadStringAsWstr(g_hInst, IDS_JOBOBJECTFAILED).c_str());
+    } else if (!AssignProcessToJobObject(g_hJob, pi.hProcess)) {
+        DWORD dwError = GetLastError();
+        DWORD dwExitCode = STILL_ACTIVE;
+        GetExitCodeProcess(pi.hProcess, &dwExitCode);
+        if ((dwError == ERROR_NOT_ENOUGH_QUOTA) || (dwExitCode != STILL_ACTIVE)) {
+            // Windows terminates a process that would exceed the process limit (counted by threadJobNotifications)
+            SendMessage(g_hStatusBar, SB_SETTEXT, 0, (LPARAM)LoadStringAsWstr(g_hInst, IDS_JOBOBJECTPROCESSLIMIT).c_str());
+            TerminateProcess(pi.hProcess, ERROR_NOT_ENOUGH_QUOTA); // Never resume a process outside of the job
+            CloseHandle(pi.hProcess);
+            CloseHandle(pi.hThread);
+            return 0;
+        }
+        // For example nested jobs are not supported before Windows 8/2012
+        SendMessage(g_hStatusBar, SB_SETTEXT, 0, (LPARAM)LoadStringAsWstr(g_hInst, IDS_JOBOBJECTFAILED).c_str());
+    }
+
+    ResumeThread(pi.hThread);
+    CloseHandle(pi.hProcess);
+    CloseHandle(pi.hThread);
+    return pi.dwProcessId;
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: toggleChaosChild
+
+  Summary:   Stops the chaos mode in the child process of the job object.
+             When the chaos mode has already ended there (e.g. by a click in
+             the child window), the chaos mode is started again in the child
+
+  Args:
+
+  Returns:  BOOL
+              TRUE = stop or start was sent
+              FALSE = no chaos mode child process is running
+
+-----------------------------------------------------------------F-F*/
+BOOL toggleChaosChild() {
+    if (g_dwChaosChildProcessId == 0) return FALSE;
+
+    HWND hChild = NULL;
+    while ((hChild = FindWindowEx(NULL, hChild, L"MainWndClass", NULL)) != NULL) {
+        DWORD dwProcessId = 0;
+        GetWindowThreadProcessId(hChild, &dwProcessId);
+        if (dwProcessId == g_dwChaosChildProcessId) break;
+    }
+    if (hChild == NULL) { // Child process has ended
+        g_dwChaosChildProcessId = 0;
+        return FALSE;
+    }
+
+    DWORD_PTR dwResult = 0;
+    if (SendMessageTimeout(hChild, WM_CHAOSSTOP, 0, 0, SMTO_ABORTIFHUNG, CHAOSSTOPTIMEOUT_MS, &dwResult) == 0)
+        PostMessage(hChild, WM_CHAOSSTOP, 0, 0); // Child is blocked, e.g. by a GUI stall event, and stops later
+    else if (dwResult == 0)
+        PostMessage(hChild, WM_COMMAND, IDM_CHAOS, 0);
+    return TRUE;
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: setMetrics
+
+  Summary:   Sets one line of the metrics panel. Empty lines are hidden
+
+  Args:     int iLine
+              METRICS_JOB, METRICS_NETWORK or METRICS_CHAOS
+            LPCWSTR szText
+              Text of the line, L"" = Hide line
+
+  Returns:
+
+-----------------------------------------------------------------F-F*/
+void setMetrics(int iLine, LPCWSTR szText) {
+    if ((iLine < 0) || (iLine >= MAXMETRICS)) return;
+    if (g_sMetrics[iLine] == szText) return; // Prevents flicker
+
+    g_sMetrics[iLine] = szText;
+    std::wstring sText;
+    for (int i = 0; i < MAXMETRICS; i++) {
+        if (g_sMetrics[i].empty()) continue;
+        if (!sText.empty()) sText.append(L"\r\n");
+        sText.append(g_sMetrics[i]);
+    }
+    if (g_hMetrics != NULL) SetWindowText(g_hMetrics, sText.c_str());
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: updateJobStatus
+
+  Summary:   Shows CPU usage, peak memory and limit violations of the job object in the metrics panel
+
+  Args:
+
+  Returns:
+
+-----------------------------------------------------------------F-F*/
+void updateJobStatus() {
+    static ULONGLONG ullLastCpuTime = 0;
+    static ULONGLONG ullLastTime = 0;
+    JOBOBJECT_BASIC_AND_IO_ACCOUNTING_INFORMATION accounting;
+    JOBOBJECT_EXTENDED_LIMIT_INFORMATION limits;
+
+    if (g_hJob == NULL) return;
+    if (!QueryInformationJobObject(g_hJob, JobObjectBasicAndIoAccountingInformation, &accounting, sizeof(accounting), NULL)) return;
+    if (!QueryInformationJobObject(g_hJob, JobObjectExtendedLimitInformation, &limits, sizeof(limits), NULL)) return;
+    if (accounting.BasicInfo.TotalProcesses == 0) { // No fault in job object
+        setMetrics(METRICS_JOB, L"");
+        return;
+    }
+
+    // CPU usage since last call in percent of all processors of all processor groups, like the CPU rate limit (times in 100 ns units)
+    DWORD dwProcessors = GetActiveProcessorCount(ALL_PROCESSOR_GROUPS);
+    ULONGLONG ullCpuTime = accounting.BasicInfo.TotalUserTime.QuadPart + accounting.BasicInfo.TotalKernelTime.QuadPart;
+    ULONGLONG ullTime = getNanoseconds() / 100;
+    int iCpuPercent = 0;
+    if ((ullLastTime != 0) && (ullTime > ullLastTime))
+        iCpuPercent = (int)((ullCpuTime - ullLastCpuTime) * 100 / ((ullTime - ullLastTime) * dwProcessors));
+    ullLastCpuTime = ullCpuTime;
+    ullLastTime = ullTime;
+
+    std::wstring sCpuLimit;
+    if (g_jobCpuLimit) sCpuLimit = std::to_wstring(JOBCPURATE_PERCENT).append(L"%");
+    else sCpuLimit = LoadStringAsWstr(g_hInst, IDS_JOBOBJECTNOCPULIMIT);
+
+    #define MAXJOBSTATUSLENGTH 255
+    wchar_t szStatus[MAXJOBSTATUSLENGTH + 1];
+    _snwprintf_s(szStatus, MAXJOBSTATUSLENGTH + 1, _TRUNCATE, LoadStringAsWstr(g_hInst, IDS_JOBOBJECTSTATUS).c_str(),
+        iCpuPercent,
+        sCpuLimit.c_str(),
+        (ULONGLONG)limits.PeakJobMemoryUsed / (1024 * 1024),
+        accounting.BasicInfo.ActiveProcesses,
+        g_lJobMemoryLimitHits,
+        g_lJobProcessLimitHits,
+        g_lJobAbnormalExits);
+    setMetrics(METRICS_JOB, szStatus);
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: countNetworkError
+
+  Summary:   Counts socket errors, that are caused by ephemeral port exhaustion
+
+  Args:     NETWORK* pNetwork
+              Pointer to network data
+            int iError
+              Winsock error code
+
+  Returns:
+
+-----------------------------------------------------------------F-F*/
+void countNetworkError(NETWORK* pNetwork, int iError) {
+    if ((iError == WSAEADDRINUSE) || (iError == WSAENOBUFS) || (iError == WSAEADDRNOTAVAIL))
+        InterlockedIncrement64(&pNetwork->llPortErrors);
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: closeNetworkSocket
+
+  Summary:   Closes the socket of an operation
+
+  Args:     NETOPERATION* pOperation
+              Pointer to operation
+
+  Returns:
+
+-----------------------------------------------------------------F-F*/
+void closeNetworkSocket(NETOPERATION* pOperation) {
+    if (pOperation->socket == INVALID_SOCKET) return;
+    closesocket(pOperation->socket);
+    pOperation->socket = INVALID_SOCKET;
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: newNetworkOperation
+
+  Summary:   Creates an operation without socket
+
+  Args:     NETWORK* pNetwork
+              Pointer to network data
+
+  Returns:  NETOPERATION*
+              Pointer to the new operation
+
+-----------------------------------------------------------------F-F*/
+NETOPERATION* newNetworkOperation(NETWORK* pNetwork) {
+    NETOPERATION* pOperation = new NETOPERATION();
+    pOperation->socket = INVALID_SOCKET;
+    pNetwork->operations.insert(pOperation);
+    return pOperation;
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: deleteNetworkOperation
+
+  Summary:   Deletes an operation and its buffer. The socket is not closed
+
+  Args:     NETWORK* pNetwork
+              Pointer to network data
+            NETOPERATION* pOperation
+              Pointer to operation
+
+  Returns:
+
+-----------------------------------------------------------------F-F*/
+void deleteNetworkOperation(NETWORK* pNetwork, NETOPERATION* pOperation) {
+    pNetwork->operations.erase(pOperation);
+    delete[] pOperation->pBuffer;
+    delete pOperation;
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: postAccept
+
+  Summary:   Starts an overlapped accept for the loopback server
+
+  Args:     NETWORK* pNetwork
+              Pointer to network data
+            NETOPERATION* pOperation
+              Pointer to operation
+
+  Returns:  BOOL
+              TRUE = success
+              FALSE = error
+
+-----------------------------------------------------------------F-F*/
+BOOL postAccept(NETWORK* pNetwork, NETOPERATION* pOperation) {
+    DWORD dwBytes = 0;
+
+    pOperation->iOperation = NETOP_ACCEPT;
+    pOperation->socket = WSASocket(AF_INET, SOCK_STREAM, IPPROTO_TCP, NULL, 0, WSA_FLAG_OVERLAPPED);
+    if (pOperation->socket == INVALID_SOCKET) {
+        countNetworkError(pNetwork, WSAGetLastError());
+        return FALSE;
+    }
+    ZeroMemory(&pOperation->overlapped, sizeof(OVERLAPPED));
+    if (!pNetwork->pAcceptEx(pNetwork->listenSocket, pOperation->socket, pOperation->acceptBuffer, 0,
+        sizeof(SOCKADDR_IN) + 16, sizeof(SOCKADDR_IN) + 16, &dwBytes, &pOperation->overlapped)) {
+        int iError = WSAGetLastError();
+        if (iError != ERROR_IO_PENDING) {
+            countNetworkError(pNetwork, iError);
+            closeNetworkSocket(pOperation);
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: postConnect
+
+  Summary:   Starts an overlapped connect to the loopback server
+
+  Args:     NETWORK* pNetwork
+              Pointer to network data
+            NETOPERATION* pOperation
+              Pointer to operation
+
+  Returns:  BOOL
+              TRUE = success
+              FALSE = error
+
+-----------------------------------------------------------------F-F*/
+BOOL postConnect(NETWORK* pNetwork, NETOPERATION* pOperation) {
+    pOperation->iOperation = NETOP_CONNECT;
+    pOperation->socket = WSASocket(AF_INET, SOCK_STREAM, IPPROTO_TCP, NULL, 0, WSA_FLAG_OVERLAPPED);
+    if (pOperation->socket == INVALID_SOCKET) {
+        countNetworkError(pNetwork, WSAGetLastError());
+        return FALSE;
+    }
+
+    // ConnectEx needs a bound socket. Port 0 = Use next ephemeral port
+    SOCKADDR_IN local;
+    ZeroMemory(&local, sizeof(local));
+    local.sin_family = AF_INET;
+    local.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    local.sin_port = 0;
+    if ((bind(pOperation->socket, (SOCKADDR*)&local, sizeof(local)) == SOCKET_ERROR)
+        || (CreateIoCompletionPort((HANDLE)pOperation->socket, pNetwork->hPort, 0, 0) == NULL)) {
+        countNetworkError(pNetwork, WSAGetLastError());
+        closeNetworkSocket(pOperation);
+        return FALSE;
+    }
+
+    ZeroMemory(&pOperation->overlapped, sizeof(OVERLAPPED));
+    if (!pNetwork->pConnectEx(pOperation->socket, (SOCKADDR*)&pNetwork->address, sizeof(pNetwork->address), NULL, 0, NULL, &pOperation->overlapped)) {
+        int iError = WSAGetLastError();
+        if (iError != ERROR_IO_PENDING) {
+            countNetworkError(pNetwork, iError);
+            closeNetworkSocket(pOperation);
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: postReceive
+
+  Summary:   Starts an overlapped receive
+
+  Args:     NETOPERATION* pOperation
+              Pointer to operation
+            int iOperation
+              NETOP_SERVERRECV or NETOP_CLIENTRECV
+
+  Returns:  BOOL
+              TRUE = success
+              FALSE = error
+
+-----------------------------------------------------------------F-F*/
+BOOL postReceive(NETOPERATION* pOperation, int iOperation) {
+    WSABUF buffer;
+    DWORD dwFlags = 0;
+
+    // Without buffer the receive completes, when the connection is closed
+    pOperation->iOperation = iOperation;
+    buffer.buf = pOperation->pBuffer;
+    buffer.len = (pOperation->pBuffer != NULL) ? NETBUFFERSIZE : 0;
+    ZeroMemory(&pOperation->overlapped, sizeof(OVERLAPPED));
+    if (WSARecv(pOperation->socket, &buffer, 1, NULL, &dwFlags, &pOperation->overlapped, NULL) == SOCKET_ERROR)
+        return (WSAGetLastError() == WSA_IO_PENDING);
+    return TRUE;
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: postSend
+
+  Summary:   Starts an overlapped send. The server sends the received bytes back,
+             the client sends a batch of messages
+
+  Args:     NETWORK* pNetwork
+              Pointer to network data
+            NETOPERATION* pOperation
+              Pointer to operation
+            int iOperation
+              NETOP_SERVERSEND or NETOP_CLIENTSEND
+            DWORD dwBytes
+              Bytes to send back (only for NETOP_SERVERSEND)
+
+  Returns:  BOOL
+              TRUE = success
+              FALSE = error
+
+-----------------------------------------------------------------F-F*/
+BOOL postSend(NETWORK* pNetwork, NETOPERATION* pOperation, int iOperation, DWORD dwBytes) {
+    DWORD dwBuffers;
+
+    pOperation->iOperation = iOperation;
+    if (iOperation == NETOP_SERVERSEND) {
+        pOperation->buffers[0].buf = pOperation->pBuffer;
+        pOperation->buffers[0].len = dwBytes;
+        dwBuffers = 1;
+    } else {
+        for (DWORD i = 0; i < g_dwNetBatch; i++) {
+            pOperation->buffers[i].buf = pNetwork->pMessage;
+            pOperation->buffers[i].len = g_dwNetMessageSize;
+        }
+        dwBuffers = g_dwNetBatch;
+        pOperation->ullStart = getNanoseconds();
+    }
+    ZeroMemory(&pOperation->overlapped, sizeof(OVERLAPPED));
+    if (WSASend(pOperation->socket, pOperation->buffers, dwBuffers, NULL, 0, &pOperation->overlapped, NULL) == SOCKET_ERROR)
+        return (WSAGetLastError() == WSA_IO_PENDING);
+    return TRUE;
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: restartOperation
+
+  Summary:   Restarts a failed or finished accept/connect.
+             When this is not possible, the operation will be retried later
+
+  Args:     NETWORK* pNetwork
+              Pointer to network data
+            NETOPERATION* pOperation
+              Pointer to operation
+
+  Returns:
+
+-----------------------------------------------------------------F-F*/
+void restartOperation(NETWORK* pNetwork, NETOPERATION* pOperation) {
+    BOOL bSuccess;
+    if (pOperation->iOperation == NETOP_ACCEPT)
+        bSuccess = postAccept(pNetwork, pOperation);
+    else
+        bSuccess = postConnect(pNetwork, pOperation);
+    if (!bSuccess) pNetwork->vIdle.push_back(pOperation);
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: closeThroughput
+
+  Summary:   Closes a connection in throughput mode. The operations are deleted (server)
+             or the connect is restarted (client), when no operation is in progress anymore
+
+  Args:     NETWORK* pNetwork
+              Pointer to network data
+            NETOPERATION* pSend
+              Pointer to send operation of the connection
+            BOOL bServer
+              TRUE = server side of the connection
+
+  Returns:
+
+-----------------------------------------------------------------F-F*/
+void closeThroughput(NETWORK* pNetwork, NETOPERATION* pSend, BOOL bServer) {
+    NETOPERATION* pReceive = pSend->pPeer;
+
+    closeNetworkSocket(pSend); // Cancels the operations in progress
+    if (pSend->bBusy || pReceive->bBusy) return; // Cleanup after their completion
+
+    InterlockedDecrement64(&pNetwork->llOpenSockets);
+    deleteNetworkOperation(pNetwork, pReceive);
+    pSend->pPeer = NULL;
+    if (bServer) {
+        deleteNetworkOperation(pNetwork, pSend);
+    } else {
+        pSend->iOperation = NETOP_CONNECT;
+        restartOperation(pNetwork, pSend);
+    }
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: continueThroughput
+
+  Summary:   Starts the next operations of a connection in throughput mode.
+             The server echoes received bytes, when its last echo is sent,
+             the client sends the next batch, when the last batch is sent and echoed.
+             A receive stays in progress, so a large send can not block both sides
+
+  Args:     NETWORK* pNetwork
+              Pointer to network data
+            NETOPERATION* pSend
+              Pointer to send operation of the connection
+            BOOL bServer
+              TRUE = server side of the connection
+
+  Returns:
+
+-----------------------------------------------------------------F-F*/
+void continueThroughput(NETWORK* pNetwork, NETOPERATION* pSend, BOOL bServer) {
+    NETOPERATION* pReceive = pSend->pPeer;
+
+    if (!pSend->bBusy) {
+        if (bServer) {
+            if (pReceive->dwLength > 0) {
+                memcpy(pSend->pBuffer, pReceive->pBuffer, pReceive->dwLength);
+                pSend->bBusy = postSend(pNetwork, pSend, NETOP_SERVERSEND, pReceive->dwLength);
+                pReceive->dwLength = 0;
+                if (!pSend->bBusy) pSend->bClosing = TRUE;
+            }
+        } else if (pSend->dwDone >= pSend->dwLength) {
+            if (pSend->dwLength > 0) addHistogramValue(&pNetwork->rtt, getNanoseconds() - pSend->ullStart);
+            pSend->dwLength = g_dwNetBatch * g_dwNetMessageSize;
+            pSend->dwDone = 0;
+            pSend->bBusy = postSend(pNetwork, pSend, NETOP_CLIENTSEND, 0);
+            if (!pSend->bBusy) pSend->bClosing = TRUE;
+        }
+    }
+
+    // The server receives no more bytes only while received bytes wait for the send of the last echo
+    if (!pSend->bClosing && !pReceive->bBusy && (pReceive->dwLength == 0)) {
+        pReceive->bBusy = postReceive(pReceive, bServer ? NETOP_SERVERRECV : NETOP_CLIENTRECV);
+        if (!pReceive->bBusy) pSend->bClosing = TRUE;
+    }
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: startThroughput
+
+  Summary:   Creates the receive operation for a new connection in throughput mode
+             and starts the first operations
+
+  Args:     NETWORK* pNetwork
+              Pointer to network data
+            NETOPERATION* pSend
+              Pointer to operation with the connected socket, will be the send operation
+            BOOL bServer
+              TRUE = server side of the connection
+
+  Returns:
+
+-----------------------------------------------------------------F-F*/
+void startThroughput(NETWORK* pNetwork, NETOPERATION* pSend, BOOL bServer) {
+    NETOPERATION* pReceive = newNetworkOperation(pNetwork);
+    pReceive->socket = pSend->socket;
+    pReceive->pBuffer = new char[NETBUFFERSIZE];
+    pReceive->pPeer = pSend;
+    pSend->pPeer = pReceive;
+    if (bServer) pSend->pBuffer = new char[NETBUFFERSIZE];
+    pSend->dwLength = 0;
+    pSend->dwDone = 0;
+    pSend->bBusy = FALSE;
+    pSend->bClosing = FALSE;
+
+    continueThroughput(pNetwork, pSend, bServer);
+    if (pSend->bClosing) closeThroughput(pNetwork, pSend, bServer);
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: processThroughputCompletion
+
+  Summary:   Processes a completed send or receive of a connection in throughput mode
+
+  Args:     NETWORK* pNetwork
+              Pointer to network data
+            NETOPERATION* pOperation
+              Pointer to send or receive operation
+            BOOL bSuccess
+              Result of GetQueuedCompletionStatus
+            DWORD dwBytes
+              Transferred bytes
+
+  Returns:
+
+-----------------------------------------------------------------F-F*/
+void processThroughputCompletion(NETWORK* pNetwork, NETOPERATION* pOperation, BOOL bSuccess, DWORD dwBytes) {
+    BOOL bServer = (pOperation->iOperation == NETOP_SERVERRECV) || (pOperation->iOperation == NETOP_SERVERSEND);
+    BOOL bReceive = (pOperation->iOperation == NETOP_SERVERRECV) || (pOperation->iOperation == NETOP_CLIENTRECV);
+    NETOPERATION* pSend = bReceive ? pOperation->pPeer : pOperation;
+
+    pOperation->bBusy = FALSE;
+    if (!bSuccess || (bReceive && (dwBytes == 0))) { // 0 bytes = Connection was closed by the other side
+        pSend->bClosing = TRUE;
+    } else if (bReceive) {
+        if (bServer) {
+            pOperation->dwLength = dwBytes; // Waits for the echo
+        } else {
+            InterlockedExchangeAdd64(&pNetwork->llBytes, dwBytes);
+            pSend->dwDone += dwBytes;
+        }
+    }
+
+    if (!pSend->bClosing) continueThroughput(pNetwork, pSend, bServer);
+    if (pSend->bClosing) closeThroughput(pNetwork, pSend, bServer);
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: processNetworkCompletion
+
+  Summary:   Processes a completed operation of the loopback network fault
+
+  Args:     NETWORK* pNetwork
+              Pointer to network data
+            NETOPERATION* pOperation
+              Pointer to operation
+            BOOL bSuccess
+              Result of GetQueuedCompletionStatus
+            DWORD dwBytes
+              Transferred bytes
+
+  Returns:
+
+-----------------------------------------------------------------F-F*/
+void processNetworkCompletion(NETWORK* pNetwork, NETOPERATION* pOperation, BOOL bSuccess, DWORD dwBytes) {
+    switch (pOperation->iOperation) {
+        case NETOP_ACCEPT:
+        {
+            if (!bSuccess) {
+                closeNetworkSocket(pOperation);
+                restartOperation(pNetwork, pOperation);
+                break;
+            }
+            // New server connection echoes data or waits for the close of the client
+            NETOPERATION* pConnection = newNetworkOperation(pNetwork);
+            pConnection->socket = pOperation->socket;
+            pOperation->socket = INVALID_SOCKET;
+            setsockopt(pConnection->socket, SOL_SOCKET, SO_UPDATE_ACCEPT_CONTEXT, (char*)&pNetwork->listenSocket, sizeof(pNetwork->listenSocket));
+            InterlockedIncrement64(&pNetwork->llOpenSockets);
+            if (CreateIoCompletionPort((HANDLE)pConnection->socket, pNetwork->hPort, 0, 0) == NULL) {
+                closeNetworkSocket(pConnection);
+                InterlockedDecrement64(&pNetwork->llOpenSockets);
+                deleteNetworkOperation(pNetwork, pConnection);
+            } else if (pNetwork->iMode == NETMODE_THROUGHPUT) {
+                startThroughput(pNetwork, pConnection, TRUE);
+            } else if (!postReceive(pConnection, NETOP_SERVERRECV)) {
+                closeNetworkSocket(pConnection);
+                InterlockedDecrement64(&pNetwork->llOpenSockets);
+                deleteNetworkOperation(pNetwork, pConnection);
+            }
+            restartOperation(pNetwork, pOperation);
+            break;
+        }
+        case NETOP_CONNECT:
+        {
+            if (!bSuccess) {
+                DWORD dwFlags = 0;
+                WSAGetOverlappedResult(pOperation->socket, &pOperation->overlapped, &dwBytes, FALSE, &dwFlags);
+                countNetworkError(pNetwork, WSAGetLastError());
+                closeNetworkSocket(pOperation);
+                restartOperation(pNetwork, pOperation);
+                break;
+            }
+            setsockopt(pOperation->socket, SOL_SOCKET, SO_UPDATE_CONNECT_CONTEXT, NULL, 0);
+            InterlockedIncrement64(&pNetwork->llConnections);
+            switch (pNetwork->iMode) {
+                case NETMODE_CHURN:
+                    closeNetworkSocket(pOperation); // Creates a TIME_WAIT for the used ephemeral port
+                    restartOperation(pNetwork, pOperation);
+                    break;
+                case NETMODE_SOCKETLEAK:
+                    InterlockedIncrement64(&pNetwork->llOpenSockets);
+                    pOperation->socket = INVALID_SOCKET; // Fault
+                    restartOperation(pNetwork, pOperation);
+                    break;
+                case NETMODE_THROUGHPUT:
+                    InterlockedIncrement64(&pNetwork->llOpenSockets);
+                    startThroughput(pNetwork, pOperation, FALSE);
+                    break;
+            }
+            break;
+        }
+        case NETOP_SERVERRECV:
+        case NETOP_SERVERSEND:
+        case NETOP_CLIENTSEND:
+        case NETOP_CLIENTRECV:
+            if (pOperation->pPeer != NULL) {
+                processThroughputCompletion(pNetwork, pOperation, bSuccess, dwBytes);
+                break;
+            }
+            // Zero length receive of the server in churn and socket leak mode => Client has closed the connection
+            closeNetworkSocket(pOperation);
+            InterlockedDecrement64(&pNetwork->llOpenSockets);
+            deleteNetworkOperation(pNetwork, pOperation);
+            break;
+    }
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: startNetwork
+
+  Summary:   Creates the loopback server and the completion port
+
+  Args:     NETWORK* pNetwork
+              Pointer to network data
+
+  Returns:  int
+              0 = success
+              Winsock error code = error
+
+-----------------------------------------------------------------F-F*/
+int startNetwork(NETWORK* pNetwork) {
+    GUID guidAcceptEx = WSAID_ACCEPTEX;
+    GUID guidConnectEx = WSAID_CONNECTEX;
+    DWORD dwBytes = 0;
+
+    pNetwork->hPort = CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, 1);
+    if (pNetwork->hPort == NULL) return (int)GetLastError();
+
+    pNetwork->listenSocket = WSASocket(AF_INET, SOCK_STREAM, IPPROTO_TCP, NULL, 0, WSA_FLAG_OVERLAPPED);
+    if (pNetwork->listenSocket == INVALID_SOCKET) return WSAGetLastError();
+
+    // Server on 127.0.0.1 with an ephemeral port
+    pNetwork->address.sin_family = AF_INET;
+    pNetwork->address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    pNetwork->address.sin_port = 0;
+    int iAddressLength = sizeof(pNetwork->address);
+    if ((bind(pNetwork->listenSocket, (SOCKADDR*)&pNetwork->address, sizeof(pNetwork->address)) == SOCKET_ERROR)
+        || (getsockname(pNetwork->listenSocket, (SOCKADDR*)&pNetwork->address, &iAddressLength) == SOCKET_ERROR)
+        || (listen(pNetwork->listenSocket, SOMAXCONN) == SOCKET_ERROR))
+        return WSAGetLastError();
+
+    if (CreateIoCompletionPort((HANDLE)pNetwork->listenSocket, pNetwork->hPort, 0, 0) == NULL) return (int)GetLastError();
+
+    // AcceptEx and ConnectEx are only available as function pointers
+    if ((WSAIoctl(pNetwork->listenSocket, SIO_GET_EXTENSION_FUNCTION_POINTER, &guidAcceptEx, sizeof(guidAcceptEx),
+            &pNetwork->pAcceptEx, sizeof(pNetwork->pAcceptEx), &dwBytes, NULL, NULL) == SOCKET_ERROR)
+        || (WSAIoctl(pNetwork->listenSocket, SIO_GET_EXTENSION_FUNCTION_POINTER, &guidConnectEx, sizeof(guidConnectEx),
+            &pNetwork->pConnectEx, sizeof(pNetwork->pConnectEx), &dwBytes, NULL, NULL) == SOCKET_ERROR))
+        return WSAGetLastError();
+
+    return 0;
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: cancelNetwork
+
+  Summary:   Closes all sockets and waits for the completions of the
+             canceled operations, before the operations are deleted
+
+  Args:     NETWORK* pNetwork
+              Pointer to network data
+
+  Returns:
+
+-----------------------------------------------------------------F-F*/
+void cancelNetwork(NETWORK* pNetwork) {
+    closesocket(pNetwork->listenSocket); // Cancels the accepts
+    pNetwork->listenSocket = INVALID_SOCKET;
+
+    // Idle operations have no operation in progress
+    for (NETOPERATION* pOperation : pNetwork->vIdle) deleteNetworkOperation(pNetwork, pOperation);
+    pNetwork->vIdle.clear();
+
+    // The receive operation of a connection in throughput mode has only a copy of the socket
+    for (NETOPERATION* pOperation : pNetwork->operations) {
+        if ((pOperation->pPeer != NULL)
+            && ((pOperation->iOperation == NETOP_SERVERRECV) || (pOperation->iOperation == NETOP_CLIENTRECV))) continue;
+        closeNetworkSocket(pOperation);
+    }
+
+    // Every remaining operation or connection in throughput mode waits for its completions
+    while (!pNetwork->operations.empty()) {
+        DWORD dwBytes = 0;
+        ULONG_PTR ulKey;
+        LPOVERLAPPED pOverlapped = NULL;
+        GetQueuedCompletionStatus(pNetwork->hPort, &dwBytes, &ulKey, &pOverlapped, INFINITE);
+        if (pOverlapped == NULL) continue;
+
+        NETOPERATION* pOperation = (NETOPERATION*)pOverlapped;
+        if (pOperation->pPeer == NULL) {
+            closeNetworkSocket(pOperation); // Socket of a finished accept or connect
+            deleteNetworkOperation(pNetwork, pOperation);
+            continue;
+        }
+        pOperation->bBusy = FALSE;
+        NETOPERATION* pPeer = pOperation->pPeer;
+        if (pPeer->bBusy) continue;
+        deleteNetworkOperation(pNetwork, pPeer);
+        deleteNetworkOperation(pNetwork, pOperation);
+    }
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: runNetwork
+
+  Summary:   Event loop for the loopback server and clients. All sockets
+             use one completion port, so one thread handles all connections
+
+  Args:     NETWORK* pNetwork
+              Pointer to network data
+
+  Returns:
+
+-----------------------------------------------------------------F-F*/
+void runNetwork(NETWORK* pNetwork) {
+    for (int i = 0; i < NETACCEPTS; i++) {
+        NETOPERATION* pOperation = newNetworkOperation(pNetwork);
+        pOperation->iOperation = NETOP_ACCEPT;
+        restartOperation(pNetwork, pOperation);
+    }
+    int iClients = (pNetwork->iMode == NETMODE_THROUGHPUT) ? NETTHROUGHPUTCLIENTS : NETCLIENTS;
+    for (int i = 0; i < iClients; i++) {
+        NETOPERATION* pOperation = newNetworkOperation(pNetwork);
+        pOperation->iOperation = NETOP_CONNECT;
+        restartOperation(pNetwork, pOperation);
+    }
+
+    // A stop posts an empty completion to end the wait
+    while (!pNetwork->lStop) {
+        DWORD dwBytes = 0;
+        ULONG_PTR ulKey;
+        LPOVERLAPPED pOverlapped = NULL;
+        BOOL bSuccess = GetQueuedCompletionStatus(pNetwork->hPort, &dwBytes, &ulKey, &pOverlapped,
+            pNetwork->vIdle.empty() ? INFINITE : NETRETRY_MS);
+        if (pOverlapped != NULL) processNetworkCompletion(pNetwork, (NETOPERATION*)pOverlapped, bSuccess, dwBytes);
+
+        // Retry failed accepts/connects by elapsed time, because completions may never stop
+        ULONGLONG ullNow = getNanoseconds();
+        if (!pNetwork->vIdle.empty() && (ullNow - pNetwork->ullLastRetry >= NETRETRY_MS * 1000000ULL)) {
+            pNetwork->ullLastRetry = ullNow;
+            std::vector<NETOPERATION*> vRetry;
+            vRetry.swap(pNetwork->vIdle);
+            for (NETOPERATION* pOperation : vRetry) restartOperation(pNetwork, pOperation);
+        }
+    }
+
+    cancelNetwork(pNetwork);
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: threadNetwork
+
+  Summary:   Runs the loopback network fault until it is stopped or fails to start.
+             The completion port and the message are freed by deleteNetwork
+
+  Args:     void* data
+              Pointer to NETWORK
+
+  Returns:  unsigned int
+              0
+
+-----------------------------------------------------------------F-F*/
+unsigned int __stdcall threadNetwork(void* data) {
+    NETWORK* pNetwork = (NETWORK*)data;
+    WSADATA wsaData;
+
+    int iError = WSAStartup(MAKEWORD(2, 2), &wsaData);
+    if (iError == 0) {
+        iError = startNetwork(pNetwork);
+        if (iError == 0) runNetwork(pNetwork);
+        if (pNetwork->listenSocket != INVALID_SOCKET) closesocket(pNetwork->listenSocket);
+        pNetwork->listenSocket = INVALID_SOCKET;
+        WSACleanup(); // Closes the leaked sockets of the socket leak mode, too
+    }
+    if (iError != 0)
+        PostMessage(g_hWnd, WM_FAULTREPORT, IDS_APP_TITLE,
+            (LPARAM)new std::wstring(LoadStringAsWstr(g_hInst, IDS_NETERROR).append(L" ").append(std::to_wstring(iError))));
+
+    InterlockedExchange(&pNetwork->lFinished, 1);
+    return 0;
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: stopNetwork
+
+  Summary:   Requests the end of the network thread
+
+  Args:     NETWORK* pNetwork
+              Pointer to network data
+
+  Returns:
+
+-----------------------------------------------------------------F-F*/
+void stopNetwork(NETWORK* pNetwork) {
+    InterlockedExchange(&pNetwork->lStop, 1);
+    // Without completion port the thread checks the stop before its first wait
+    if (pNetwork->hPort != NULL) PostQueuedCompletionStatus(pNetwork->hPort, 0, 0, NULL);
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: deleteNetwork
+
+  Summary:   Frees the data of an ended network thread
+
+  Args:     NETWORK* pNetwork
+              Pointer to network data or NULL
+
+  Returns:
+
+-----------------------------------------------------------------F-F*/
+void deleteNetwork(NETWORK* pNetwork) {
+    if (pNetwork == NULL) return;
+    if (pNetwork->hPort != NULL) CloseHandle(pNetwork->hPort);
+    delete[] pNetwork->pMessage;
+    delete pNetwork;
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: updateNetworkStatus
+
+  Summary:   Shows connections/s, MB/s, RTT percentiles, open sockets and
+             port errors of the loopback network fault in the status bar
+
+  Args:
+
+  Returns:
+
+-----------------------------------------------------------------F-F*/
+void updateNetworkStatus() {
+    static LONG64 llLastConnections = 0;
+    static LONG64 llLastBytes = 0;
+    static ULONGLONG ullLastTime = 0;
+
+    if ((g_pNetwork == NULL) || g_pNetwork->lFinished) {
+        llLastConnections = 0;
+        llLastBytes = 0;
+        ullLastTime = 0;
+        setMetrics(METRICS_NETWORK, L"");
+        return;
+    }
+
+    LONG64 llConnections = g_pNetwork->llConnections;
+    LONG64 llBytes = g_pNetwork->llBytes;
+    ULONGLONG ullTime = getNanoseconds();
+    double dSeconds = (ullLastTime == 0) ? 0.0 : (ullTime - ullLastTime) / 1000000000.0;
+    double dConnections = (dSeconds > 0.0) ? (llConnections - llLastConnections) / dSeconds : 0.0;
+    double dMegabytes = (dSeconds > 0.0) ? (llBytes - llLastBytes) / dSeconds / (1024.0 * 1024.0) : 0.0;
+    llLastConnections = llConnections;
+    llLastBytes = llBytes;
+    ullLastTime = ullTime;
+
+    #define MAXNETSTATUSLENGTH 255
+    wchar_t szStatus[MAXNETSTATUSLENGTH + 1];
+    _snwprintf_s(szStatus, MAXNETSTATUSLENGTH + 1, _TRUNCATE, LoadStringAsWstr(g_hInst, IDS_NETSTATUS).c_str(),
+        dConnections,
+        dMegabytes,
+        formatNanoseconds(getHistogramPercentile(&g_pNetwork->rtt, 50)).c_str(),
+        formatNanoseconds(getHistogramPercentile(&g_pNetwork->rtt, 99)).c_str(),
+        g_pNetwork->llOpenSockets,
+        g_pNetwork->llPortErrors);
+    setMetrics(METRICS_NETWORK, szStatus);
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: isModuleLoaded
+
+  Summary:   Checks, if a DLL is loaded in a process
+
+  Args:     DWORD dwProcessId
+              Process ID
+            const std::wstring& sModule
+              Full path of the DLL
+
+  Returns:  BOOL
+              TRUE = DLL is loaded
+
+-----------------------------------------------------------------F-F*/
+BOOL isModuleLoaded(DWORD dwProcessId, const std::wstring& sModule) {
+    HANDLE hSnapshot;
+    do { // Snapshot can fail, while the process loads or unloads modules
+        hSnapshot = CreateToolhelp32Snapshot(TH32CS_SNAPMODULE, dwProcessId);
+    } while ((hSnapshot == INVALID_HANDLE_VALUE) && (GetLastError() == ERROR_BAD_LENGTH));
+    if (hSnapshot == INVALID_HANDLE_VALUE) return FALSE;
+
+    BOOL bLoaded = FALSE;
+    MODULEENTRY32 module;
+    module.dwSize = sizeof(module);
+    for (BOOL bNext = Module32First(hSnapshot, &module); bNext && !bLoaded; bNext = Module32Next(hSnapshot, &module)) {
+        if (_wcsicmp(module.szExePath, sModule.c_str()) == 0) bLoaded = TRUE;
+    }
+    CloseHandle(hSnapshot);
+    return bLoaded;
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: injectAllocationHook
+
+  Summary:   Loads appFaultsHook.dll with the allocation instrumentation into
+             another process (CreateRemoteThread with LoadLibraryW). Both
+             processes must have the same architecture (x86 or x64)
+
+  Args:     DWORD dwProcessId
+              Process ID
+
+  Returns:  DWORD
+              ERROR_SUCCESS or Windows error code
+
+-----------------------------------------------------------------F-F*/
+DWORD injectAllocationHook(DWORD dwProcessId) {
+    wchar_t szProgram[MAX_PATH];
+    DWORD dwLength = GetModuleFileName(NULL, szProgram, MAX_PATH);
+    if ((dwLength == 0) || (dwLength >= MAX_PATH)) return ERROR_BAD_PATHNAME;
+    std::wstring sHook(szProgram);
+    sHook = sHook.substr(0, sHook.find_last_of(L'\\') + 1).append(ALLOCHOOKDLL);
+    if (GetFileAttributes(sHook.c_str()) == INVALID_FILE_ATTRIBUTES) return ERROR_FILE_NOT_FOUND;
+
+    HANDLE hProcess = OpenProcess(PROCESS_CREATE_THREAD | PROCESS_QUERY_INFORMATION | PROCESS_VM_OPERATION | PROCESS_VM_READ | PROCESS_VM_WRITE, FALSE, dwProcessId);
+    if (hProcess == NULL) return GetLastError();
+
+    // The address of LoadLibraryW is only valid for a process with the same architecture
+    BOOL bWow64 = FALSE;
+    BOOL bWow64Target = FALSE;
+    IsWow64Process(GetCurrentProcess(), &bWow64);
+    IsWow64Process(hProcess, &bWow64Target);
+    if (bWow64 != bWow64Target) {
+        CloseHandle(hProcess);
+        return ERROR_BAD_EXE_FORMAT;
+    }
+
+    DWORD dwError = ERROR_SUCCESS;
+    SIZE_T size = (sHook.length() + 1) * sizeof(wchar_t);
+    LPVOID pRemoteHook = VirtualAllocEx(hProcess, NULL, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    if (pRemoteHook == NULL) {
+        dwError = GetLastError();
+        CloseHandle(hProcess);
+        return dwError;
+    }
+
+    // kernel32.dll has the same address in all processes with the same architecture
+    HANDLE hThread = NULL;
+    LPTHREAD_START_ROUTINE pLoadLibrary = (LPTHREAD_START_ROUTINE)GetProcAddress(GetModuleHandle(L"kernel32.dll"), "LoadLibraryW");
+    if ((pLoadLibrary == NULL) || !WriteProcessMemory(hProcess, pRemoteHook, sHook.c_str(), size, NULL)
+        || ((hThread = CreateRemoteThread(hProcess, NULL, 0, pLoadLibrary, pRemoteHook, 0, NULL)) == NULL)) {
+        dwError = GetLastError();
+        VirtualFreeEx(hProcess, pRemoteHook, 0, MEM_RELEASE);
+        CloseHandle(hProcess);
+        return dwError;
+    }
+
+    if (WaitForSingleObject(hThread, ALLOCINJECTTIMEOUT_MS) == WAIT_OBJECT_0) {
+        // The exit code has only the lower 32 bits of the module handle, so the module list of the process is checked
+        if (!isModuleLoaded(dwProcessId, sHook)) dwError = ERROR_DLL_INIT_FAILED;
+        VirtualFreeEx(hProcess, pRemoteHook, 0, MEM_RELEASE);
+    } else dwError = WAIT_TIMEOUT; // Path is still needed by the thread, memory is not released
+
+    CloseHandle(hThread);
+    CloseHandle(hProcess);
+    return dwError;
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: initRateLimit
+
+  Summary:   Initializes a rate limit with the fault intensity in percent of a capacity.
+             The rate is unlimited for an intensity of 100%. A limited rate sets the
+             timer resolution to 1 ms until endRateLimit
+
+  Args:     RATELIMIT* pLimit
+              Pointer to rate limit
+            double dCapacity
+              Operations per second at 100%
+
+  Returns:
+
+-----------------------------------------------------------------F-F*/
+void initRateLimit(RATELIMIT* pLimit, double dCapacity) {
+    pLimit->dRate = (g_iIntensityPercent >= 100) ? 0.0 : dCapacity * g_iIntensityPercent / 100.0;
+    pLimit->ullStart = getNanoseconds();
+    pLimit->ullCount = 0;
+    if (pLimit->dRate > 0.0) timeBeginPeriod(1); // Sleep would wait at least 15.6 ms with the default resolution
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: endRateLimit
+
+  Summary:   Restores the timer resolution of a limited rate
+
+  Args:     RATELIMIT* pLimit
+              Pointer to rate limit
+
+  Returns:
+
+-----------------------------------------------------------------F-F*/
+void endRateLimit(RATELIMIT* pLimit) {
+    if (pLimit->dRate > 0.0) timeEndPeriod(1);
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: waitRateLimit
+
+  Summary:   Counts an operation and sleeps, when the operations are ahead of the rate
+
+  Args:     RATELIMIT* pLimit
+              Pointer to rate limit
+
+  Returns:
+
+-----------------------------------------------------------------F-F*/
+void waitRateLimit(RATELIMIT* pLimit) {
+    if (pLimit->dRate <= 0.0) return;
+
+    pLimit->ullCount++;
+    double dDue = pLimit->ullCount * 1000000000.0 / pLimit->dRate; // ns after start
+    double dElapsed = (double)(getNanoseconds() - pLimit->ullStart);
+    if (dDue - dElapsed >= 1000000.0) Sleep((DWORD)((dDue - dElapsed) / 1000000.0));
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: threadEmpty
+
+  Summary:   Thread function without work (for thread creation rate)
+
+  Args:     void* data
+              Unused
+
+  Returns:  unsigned int
+              0
+
+-----------------------------------------------------------------F-F*/
+unsigned int __stdcall threadEmpty(void* data) {
+    return 0;
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: measureTopology
+
+  Summary:   Gets the number of logical processors, cores, packages and NUMA nodes
+             and the logical processors of every core. The cores are interleaved over
+             the NUMA nodes (first core of each node, second core of each node ...),
+             so the first n cores are spread over all nodes
+
+  Args:
+
+  Returns:
+
+-----------------------------------------------------------------F-F*/
+void measureTopology() {
+    std::vector<GROUP_AFFINITY> vCores;
+    std::vector<GROUP_AFFINITY> vNodes;
+
+    g_calibration.dwLogicalProcessors = GetActiveProcessorCount(ALL_PROCESSOR_GROUPS);
+    g_calibration.dwCores = 0;
+    g_calibration.dwPackages = 0;
+    g_calibration.dwNumaNodes = 0;
+    g_vCores.clear();
+
+    DWORD dwLength = 0;
+    GetLogicalProcessorInformationEx(RelationAll, NULL, &dwLength);
+    if (GetLastError() == ERROR_INSUFFICIENT_BUFFER) {
+        BYTE* pBuffer = new BYTE[dwLength];
+        if (GetLogicalProcessorInformationEx(RelationAll, (PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX)pBuffer, &dwLength)) {
+            for (DWORD dwOffset = 0; dwOffset < dwLength; ) {
+                PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX pInfo = (PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX)(pBuffer + dwOffset);
+                switch (pInfo->Relationship) {
+                    case RelationProcessorCore:
+                        g_calibration.dwCores++;
+                        vCores.push_back(pInfo->Processor.GroupMask[0]); // A core is always in one processor group
+                        break;
+                    case RelationProcessorPackage:
+                        g_calibration.dwPackages++;
+                        break;
+                    case RelationNumaNode:
+                        g_calibration.dwNumaNodes++;
+                        vNodes.push_back(pInfo->NumaNode.GroupMask);
+                        break;
+                }
+                dwOffset += pInfo->Size;
+            }
+        }
+        delete[] pBuffer;
+    }
+
+    // Cores per NUMA node
+    std::vector<std::vector<GROUP_AFFINITY>> vNodeCores(max(vNodes.size(), (size_t)1));
+    for (GROUP_AFFINITY& core : vCores) {
+        size_t node = 0;
+        for (size_t i = 0; i < vNodes.size(); i++) {
+            if ((vNodes[i].Group == core.Group) && ((vNodes[i].Mask & core.Mask) != 0)) node = i;
+        }
+        GROUP_AFFINITY affinity;
+        ZeroMemory(&affinity, sizeof(affinity));
+        affinity.Group = core.Group;
+        affinity.Mask = core.Mask;
+        vNodeCores[node].push_back(affinity);
+    }
+
+    // Interleave the cores of the nodes
+    for (size_t i = 0; g_vCores.size() < vCores.size(); i++) {
+        for (std::vector<GROUP_AFFINITY>& nodeCores : vNodeCores) {
+            if (i < nodeCores.size()) g_vCores.push_back(nodeCores[i]);
+        }
+    }
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: startThreadOnCore
+
+  Summary:   Starts a thread, that runs only on the logical processors of one core
+
+  Args:     unsigned int (__stdcall* pThreadFunction)(void*)
+              Thread function
+            void* data
+              Argument for thread function
+            DWORD dwCore
+              Index of core (modulo number of cores)
+
+  Returns:  HANDLE
+              Handle to thread
+              NULL = error
+
+-----------------------------------------------------------------F-F*/
+HANDLE startThreadOnCore(unsigned int (__stdcall* pThreadFunction)(void*), void* data, DWORD dwCore) {
+    HANDLE hThread = (HANDLE)_beginthreadex(0, 0, pThreadFunction, data, CREATE_SUSPENDED, 0);
+    if (hThread == NULL) return NULL;
+    if (!g_vCores.empty()) SetThreadGroupAffinity(hThread, &g_vCores[dwCore % g_vCores.size()], NULL);
+    ResumeThread(hThread);
+    return hThread;
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: getBandwidthThreads
+
+  Summary:   Returns the number of threads for memory bandwidth calibration and fault
+             (one per core, so all memory controllers are used)
+
+  Args:
+
+  Returns:  DWORD
+              Number of threads
+
+-----------------------------------------------------------------F-F*/
+DWORD getBandwidthThreads() {
+    DWORD dwCores = (g_calibration.dwCores > 0) ? g_calibration.dwCores : g_calibration.dwLogicalProcessors;
+    DWORD dwThreads = min(dwCores, (DWORD)MAXBANDWIDTHTHREADS);
+    return max(dwThreads, 1UL);
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: getBandwidthBufferSize
+
+  Summary:   Returns the size of the source and destination buffer per thread
+             for memory bandwidth calibration and fault. All buffers together
+             should be larger than the caches, but not too large for many cores
+
+  Args:
+
+  Returns:  size_t
+              Bytes (multiple of BANDWIDTHCHUNKSIZE)
+
+-----------------------------------------------------------------F-F*/
+size_t getBandwidthBufferSize() {
+    size_t bufferSize = BANDWIDTHTOTALBUFFERSIZE / getBandwidthThreads();
+    bufferSize = max(bufferSize, (size_t)BANDWIDTHMINBUFFERSIZE);
+    return bufferSize - bufferSize % BANDWIDTHCHUNKSIZE;
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: threadBandwidthMeasurement
+
+  Summary:   Copies memory until the end of the measurement
+
+  Args:     void* data
+              Pointer to BANDWIDTHMEASUREMENT
+
+  Returns:  unsigned int
+              0
+
+-----------------------------------------------------------------F-F*/
+unsigned int __stdcall threadBandwidthMeasurement(void* data) {
+    BANDWIDTHMEASUREMENT* pMeasurement = (BANDWIDTHMEASUREMENT*)data;
+    size_t bufferSize = getBandwidthBufferSize();
+    char* pSource = (char*)malloc(bufferSize);
+    char* pDestination = (char*)malloc(bufferSize);
+
+    if ((pSource != NULL) && (pDestination != NULL)) {
+        memset(pSource, 1, bufferSize);
+        memset(pDestination, 0, bufferSize);
+        size_t offset = 0;
+        while (getNanoseconds() < pMeasurement->ullEnd) {
+            memcpy(pDestination + offset, pSource + offset, BANDWIDTHCHUNKSIZE);
+            offset = (offset + BANDWIDTHCHUNKSIZE) % bufferSize;
+            InterlockedExchangeAdd64(&pMeasurement->llBytes, BANDWIDTHCHUNKSIZE);
+        }
+    }
+    free(pSource);
+    free(pDestination);
+    return 0;
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: calibrate
+
+  Summary:   Measures the capacity of the machine: Allocation rate, memory bandwidth,
+             thread and handle creation rate. The processor topology must be measured
+             before. Needs a few seconds
+
+  Args:     CALIBRATION* pCalibration
+              Pointer to calibration for the results
+
+  Returns:
+
+-----------------------------------------------------------------F-F*/
+void calibrate(CALIBRATION* pCalibration) {
+    // Allocation rate
+    double dAllocationCost = measureAllocationCost();
+    pCalibration->dAllocationsPerSecond = (dAllocationCost > 0.0) ? 1000000000.0 / dAllocationCost : 0.0;
+
+    // Memory bandwidth
+    BANDWIDTHMEASUREMENT measurement;
+    measurement.llBytes = 0;
+    ULONGLONG ullStart = getNanoseconds();
+    measurement.ullEnd = ullStart + CALIBRATIONDURATION_MS * 1000000ULL;
+    std::vector<HANDLE> vThreads;
+    for (DWORD i = 0; i < getBandwidthThreads(); i++) {
+        HANDLE hThread = startThreadOnCore(&threadBandwidthMeasurement, (void*)&measurement, i);
+        if (hThread != NULL) vThreads.push_back(hThread);
+    }
+    for (HANDLE hThread : vThreads) {
+        WaitForSingleObject(hThread, INFINITE);
+        CloseHandle(hThread);
+    }
+    pCalibration->dBandwidth = measurement.llBytes * 1000000000.0 / (getNanoseconds() - ullStart);
+
+    // Thread creation rate
+    ULONGLONG ullCount = 0;
+    ullStart = getNanoseconds();
+    ULONGLONG ullEnd = ullStart + CALIBRATIONDURATION_MS * 1000000ULL;
+    while (getNanoseconds() < ullEnd) {
+        HANDLE hThread = (HANDLE)_beginthreadex(0, 0, &threadEmpty, NULL, 0, 0);
+        if (hThread == NULL) break;
+        WaitForSingleObject(hThread, INFINITE);
+        CloseHandle(hThread);
+        ullCount++;
+    }
+    pCalibration->dThreadsPerSecond = ullCount * 1000000000.0 / (getNanoseconds() - ullStart);
+
+    // Handle creation rate (same handle type as the handle leak)
+    ullCount = 0;
+    ullStart = getNanoseconds();
+    ullEnd = ullStart + CALIBRATIONDURATION_MS * 1000000ULL;
+    while (getNanoseconds() < ullEnd) {
+        HANDLE hProcess = OpenProcess(PROCESS_ALL_ACCESS, FALSE, GetCurrentProcessId());
+        if (hProcess == NULL) break;
+        CloseHandle(hProcess);
+        ullCount++;
+    }
+    pCalibration->dHandlesPerSecond = ullCount * 1000000000.0 / (getNanoseconds() - ullStart);
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: threadCalibration
+
+  Summary:   Calibrates in the background and sends the result as
+             WM_CALIBRATIONDONE to the main window
+
+  Args:     void* data
+              TRUE = New calibration by the user, FALSE = Calibration at program start
+
+  Returns:  unsigned int
+              0
+
+-----------------------------------------------------------------F-F*/
+unsigned int __stdcall threadCalibration(void* data) {
+    CALIBRATION* pCalibration = new CALIBRATION(g_calibration); // With the measured processor topology
+    calibrate(pCalibration);
+    PostMessage(g_hWnd, WM_CALIBRATIONDONE, (WPARAM)data, (LPARAM)pCalibration);
+    return 0;
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: startCalibration
+
+  Summary:   Measures the processor topology and starts the calibration thread.
+             g_calibration keeps its values until the calibration is done
+
+  Args:     BOOL bByUser
+              TRUE = New calibration by the user, FALSE = Calibration at program start
+
+  Returns:
+
+-----------------------------------------------------------------F-F*/
+void startCalibration(BOOL bByUser) {
+    measureTopology();
+    g_calibrationRunning = TRUE;
+    SendMessage(g_hStatusBar, SB_SETTEXT, 0, (LPARAM)LoadStringAsWstr(g_hInst, IDS_CALIBRATIONRUNNING).c_str());
+
+    HANDLE hThread = (HANDLE)_beginthreadex(0, 0, &threadCalibration, (void*)(INT_PTR)bByUser, 0, 0);
+    if (hThread != NULL) CloseHandle(hThread); else threadCalibration((void*)(INT_PTR)bByUser); // Without thread in the GUI thread
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: finishStartup
+
+  Summary:   Enables the allocation instrumentation and starts the requested fault
+             from the command line, when the calibration is available
+
+  Args:
+
+  Returns:
+
+-----------------------------------------------------------------F-F*/
+void finishStartup() {
+    if (g_allocInstrumentation) setAllocationInstrumentation(TRUE);
+    if (g_uStartFault != 0) PostMessage(g_hWnd, WM_COMMAND, g_uStartFault, 0);
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: getSettingsFile
+
+  Summary:   Returns the path of a file in %LOCALAPPDATA%\appFaults and creates the folder
+
+  Args:     LPCWSTR szFileName
+              Name of file
+
+  Returns:  std::wstring
+              Path of file
+              Empty = %LOCALAPPDATA% not found
+
+-----------------------------------------------------------------F-F*/
+std::wstring getSettingsFile(LPCWSTR szFileName) {
+    wchar_t szLocalAppData[MAX_PATH];
+    DWORD dwLength = GetEnvironmentVariable(L"LOCALAPPDATA", szLocalAppData, MAX_PATH);
+    if ((dwLength == 0) || (dwLength >= MAX_PATH)) return std::wstring();
+
+    std::wstring sFile(szLocalAppData);
+    sFile.append(L"\\appFaults");
+    CreateDirectory(sFile.c_str(), NULL);
+    sFile.append(L"\\").append(szFileName);
+    return sFile;
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: saveCalibration
+
+  Summary:   Saves the calibration in the cache file
+
+  Args:
+
+  Returns:
+
+-----------------------------------------------------------------F-F*/
+void saveCalibration() {
+    std::wstring sFile(getSettingsFile(CALIBRATIONFILE));
+    if (sFile.empty()) return;
+
+    wchar_t szComputerName[MAX_COMPUTERNAME_LENGTH + 1];
+    DWORD dwSize = MAX_COMPUTERNAME_LENGTH + 1;
+    if (!GetComputerName(szComputerName, &dwSize)) szComputerName[0] = L'\0';
+
+    WritePrivateProfileString(CALIBRATIONSECTION, L"Version", std::to_wstring(CALIBRATIONVERSION).c_str(), sFile.c_str());
+    WritePrivateProfileString(CALIBRATIONSECTION, L"ComputerName", szComputerName, sFile.c_str());
+    WritePrivateProfileString(CALIBRATIONSECTION, L"LogicalProcessors", std::to_wstring(g_calibration.dwLogicalProcessors).c_str(), sFile.c_str());
+    WritePrivateProfileString(CALIBRATIONSECTION, L"Cores", std::to_wstring(g_calibration.dwCores).c_str(), sFile.c_str());
+    WritePrivateProfileString(CALIBRATIONSECTION, L"Packages", std::to_wstring(g_calibration.dwPackages).c_str(), sFile.c_str());
+    WritePrivateProfileString(CALIBRATIONSECTION, L"NumaNodes", std::to_wstring(g_calibration.dwNumaNodes).c_str(), sFile.c_str());
+    WritePrivateProfileString(CALIBRATIONSECTION, L"AllocationsPerSecond", std::to_wstring(g_calibration.dAllocationsPerSecond).c_str(), sFile.c_str());
+    WritePrivateProfileString(CALIBRATIONSECTION, L"Bandwidth", std::to_wstring(g_calibration.dBandwidth).c_str(), sFile.c_str());
+    WritePrivateProfileString(CALIBRATIONSECTION, L"ThreadsPerSecond", std::to_wstring(g_calibration.dThreadsPerSecond).c_str(), sFile.c_str());
+    WritePrivateProfileString(CALIBRATIONSECTION, L"HandlesPerSecond", std::to_wstring(g_calibration.dHandlesPerSecond).c_str(), sFile.c_str());
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: getSettingsValue
+
+  Summary:   Reads a number from a settings file
+
+  Args:     const std::wstring& sFile
+              Path of settings file
+            LPCWSTR szSection
+              Section name
+            LPCWSTR szKey
+              Key name
+            double dDefault
+              Value, if key is not found
+
+  Returns:  double
+              Value
+
+-----------------------------------------------------------------F-F*/
+double getSettingsValue(const std::wstring& sFile, LPCWSTR szSection, LPCWSTR szKey, double dDefault) {
+    #define MAXSETTINGSVALUELENGTH 63
+    wchar_t szValue[MAXSETTINGSVALUELENGTH + 1];
+    GetPrivateProfileString(szSection, szKey, L"", szValue, MAXSETTINGSVALUELENGTH + 1, sFile.c_str());
+    return (szValue[0] == L'\0') ? dDefault : _wtof(szValue);
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: loadCalibration
+
+  Summary:   Loads the calibration from the cache file. The cache is only valid
+             for the same version, computer name and number of logical processors.
+             The processor topology is measured every time
+
+  Args:
+
+  Returns:  BOOL
+              TRUE = success
+              FALSE = no valid cache
+
+-----------------------------------------------------------------F-F*/
+BOOL loadCalibration() {
+    std::wstring sFile(getSettingsFile(CALIBRATIONFILE));
+    if (sFile.empty()) return FALSE;
+
+    wchar_t szComputerName[MAX_COMPUTERNAME_LENGTH + 1];
+    wchar_t szCachedName[MAX_COMPUTERNAME_LENGTH + 1];
+    DWORD dwSize = MAX_COMPUTERNAME_LENGTH + 1;
+    if (!GetComputerName(szComputerName, &dwSize)) return FALSE;
+    GetPrivateProfileString(CALIBRATIONSECTION, L"ComputerName", L"", szCachedName, MAX_COMPUTERNAME_LENGTH + 1, sFile.c_str());
+    if (_wcsicmp(szComputerName, szCachedName) != 0) return FALSE;
+    if ((DWORD)getSettingsValue(sFile, CALIBRATIONSECTION, L"LogicalProcessors", 0.0) != GetActiveProcessorCount(ALL_PROCESSOR_GROUPS)) return FALSE;
+    if ((int)getSettingsValue(sFile, CALIBRATIONSECTION, L"Version", 0.0) != CALIBRATIONVERSION) return FALSE;
+
+    measureTopology();
+    g_calibration.dAllocationsPerSecond = getSettingsValue(sFile, CALIBRATIONSECTION, L"AllocationsPerSecond", 0.0);
+    g_calibration.dBandwidth = getSettingsValue(sFile, CALIBRATIONSECTION, L"Bandwidth", 0.0);
+    g_calibration.dThreadsPerSecond = getSettingsValue(sFile, CALIBRATIONSECTION, L"ThreadsPerSecond", 0.0);
+    g_calibration.dHandlesPerSecond = getSettingsValue(sFile, CALIBRATIONSECTION, L"HandlesPerSecond", 0.0);
+    return (g_calibration.dAllocationsPerSecond > 0.0) && (g_calibration.dBandwidth > 0.0)
+        && (g_calibration.dThreadsPerSecond > 0.0) && (g_calibration.dHandlesPerSecond > 0.0);
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: getCalibrationReport
+
+  Summary:   Returns the calibration as text
+
+  Args:
+
+  Returns:  std::wstring
+
+-----------------------------------------------------------------F-F*/
+std::wstring getCalibrationReport() {
+    #define MAXCALIBRATIONREPORTLENGTH 511
+    wchar_t szReport[MAXCALIBRATIONREPORTLENGTH + 1];
+    _snwprintf_s(szReport, MAXCALIBRATIONREPORTLENGTH + 1, _TRUNCATE, LoadStringAsWstr(g_hInst, IDS_CALIBRATIONRESULT).c_str(),
+        g_calibration.dwLogicalProcessors,
+        g_calibration.dwCores,
+        g_calibration.dwPackages,
+        g_calibration.dwNumaNodes,
+        g_calibration.dAllocationsPerSecond,
+        g_calibration.dBandwidth / 1000000000.0,
+        g_calibration.dThreadsPerSecond,
+        g_calibration.dHandlesPerSecond);
+    return std::wstring(szReport);
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: threadMemoryBandwidth
+
+  Summary:   Faulty thread function, that copies memory until the stop with
+             its share of the fault intensity in percent of the calibrated memory bandwidth
+
+  Args:     void* data
+              Unused
+
+  Returns:  unsigned int
+              0
+
+-----------------------------------------------------------------F-F*/
+unsigned int __stdcall threadMemoryBandwidth(void* data) {
+    size_t bufferSize = getBandwidthBufferSize();
+    char* pSource = (char*)malloc(bufferSize);
+    char* pDestination = (char*)malloc(bufferSize);
+    if ((pSource != NULL) && (pDestination != NULL)) {
+        memset(pSource, 1, bufferSize);
+
+        RATELIMIT limit;
+        initRateLimit(&limit, g_calibration.dBandwidth / getBandwidthThreads() / BANDWIDTHCHUNKSIZE);
+        size_t offset = 0;
+        while (!g_lMemoryBandwidthStop) {
+            memcpy(pDestination + offset, pSource + offset, BANDWIDTHCHUNKSIZE); // Fault
+            offset = (offset + BANDWIDTHCHUNKSIZE) % bufferSize;
+            waitRateLimit(&limit);
+        }
+        endRateLimit(&limit);
+    }
+    free(pSource);
+    free(pDestination);
+    InterlockedDecrement(&g_lMemoryBandwidthThreads);
+    return 0;
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: setIntensity
+
+  Summary:   Sets the fault intensity and checks the matching window menu entry
+
+  Args:     HWND hWindow
+              Handle to main window
+            UINT uID
+              IDM_INTENSITY25...IDM_INTENSITY100
+
+  Returns:
+
+-----------------------------------------------------------------F-F*/
+void setIntensity(HWND hWindow, UINT uID) {
+    g_iIntensityPercent = 25 * (uID - IDM_INTENSITY25 + 1);
+
+    HMENU hSysMenu = GetSystemMenu(hWindow, FALSE);
+    if (hSysMenu != NULL) CheckMenuRadioItem(hSysMenu, IDM_INTENSITY25, IDM_INTENSITY100, uID, MF_BYCOMMAND);
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: getRandom
+
+  Summary:   Returns the next number of a pseudo random number generator (SplitMix64).
+             Same seed, same sequence of numbers
+
+  Args:     ULONGLONG* pState
+              Pointer to state of generator
+
+  Returns:  ULONGLONG
+              Random number
+
+-----------------------------------------------------------------F-F*/
+ULONGLONG getRandom(ULONGLONG* pState) {
+    ULONGLONG z = (*pState += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: getRandomRange
+
+  Summary:   Returns a uniformly distributed random number in a range
+
+  Args:     ULONGLONG* pState
+              Pointer to state of generator
+            DWORD dwMin
+              Smallest value
+            DWORD dwMax
+              Largest value
+
+  Returns:  DWORD
+              Random number
+
+-----------------------------------------------------------------F-F*/
+DWORD getRandomRange(ULONGLONG* pState, DWORD dwMin, DWORD dwMax) {
+    if (dwMax <= dwMin) return dwMin;
+    return dwMin + (DWORD)(getRandom(pState) % ((ULONGLONG)dwMax - dwMin + 1));
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: getRandomExponential
+
+  Summary:   Returns an exponentially distributed random number
+             (time between two events of a Poisson process)
+
+  Args:     ULONGLONG* pState
+              Pointer to state of generator
+            double dRate
+              Events per time unit
+
+  Returns:  double
+              Time until next event
+
+-----------------------------------------------------------------F-F*/
+double getRandomExponential(ULONGLONG* pState, double dRate) {
+    double dUniform = (getRandom(pState) >> 11) * (1.0 / 9007199254740992.0); // [0,1) with 53 bits
+    return -log(1.0 - dUniform) / dRate;
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: loadChaosSettings
+
+  Summary:   Loads the distributions of the chaos event types from chaos.ini
+             and writes all values back, so the file shows every setting
+
+  Args:
+
+  Returns:
+
+-----------------------------------------------------------------F-F*/
+void loadChaosSettings() {
+    std::wstring sFile(getSettingsFile(CHAOSFILE));
+    if (sFile.empty()) return;
+
+    for (int i = 0; i < MAXCHAOSTYPES; i++) {
+        CHAOSTYPE* pType = &g_chaosTypes[i];
+        std::wstring sName(pType->szName);
+        pType->dRate = getSettingsValue(sFile, CHAOSSECTION, (sName + L"Rate").c_str(), pType->dRate);
+        pType->dwMinDuration = (DWORD)getSettingsValue(sFile, CHAOSSECTION, (sName + L"MinDuration").c_str(), pType->dwMinDuration);
+        pType->dwMaxDuration = (DWORD)getSettingsValue(sFile, CHAOSSECTION, (sName + L"MaxDuration").c_str(), pType->dwMaxDuration);
+        pType->dwMinIntensity = (DWORD)getSettingsValue(sFile, CHAOSSECTION, (sName + L"MinIntensity").c_str(), pType->dwMinIntensity);
+        pType->dwMaxIntensity = (DWORD)getSettingsValue(sFile, CHAOSSECTION, (sName + L"MaxIntensity").c_str(), pType->dwMaxIntensity);
+
+        WritePrivateProfileString(CHAOSSECTION, (sName + L"Rate").c_str(), std::to_wstring(pType->dRate).c_str(), sFile.c_str());
+        WritePrivateProfileString(CHAOSSECTION, (sName + L"MinDuration").c_str(), std::to_wstring(pType->dwMinDuration).c_str(), sFile.c_str());
+        WritePrivateProfileString(CHAOSSECTION, (sName + L"MaxDuration").c_str(), std::to_wstring(pType->dwMaxDuration).c_str(), sFile.c_str());
+        WritePrivateProfileString(CHAOSSECTION, (sName + L"MinIntensity").c_str(), std::to_wstring(pType->dwMinIntensity).c_str(), sFile.c_str());
+        WritePrivateProfileString(CHAOSSECTION, (sName + L"MaxIntensity").c_str(), std::to_wstring(pType->dwMaxIntensity).c_str(), sFile.c_str());
+    }
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: addChaosEvent
+
+  Summary:   Inserts an event into the hierarchical timer wheel in O(1).
+             The level is the lowest one, whose current block contains the event
+
+  Args:     CHAOS* pChaos
+              Pointer to chaos data
+            CHAOSEVENT* pEvent
+              Pointer to event
+
+  Returns:
+
+-----------------------------------------------------------------F-F*/
+void addChaosEvent(CHAOS* pChaos, CHAOSEVENT* pEvent) {
+    ULONGLONG ullTick = max(pEvent->ullTick, pChaos->ullTick); // Events in the past start with the next tick
+
+    int iLevel = 0;
+    while ((iLevel < WHEELLEVELS - 1)
+        && ((ullTick >> (WHEELSLOTBITS * (iLevel + 1))) != (pChaos->ullTick >> (WHEELSLOTBITS * (iLevel + 1))))) iLevel++;
+    int iSlot = (int)((ullTick >> (WHEELSLOTBITS * iLevel)) & (WHEELSLOTS - 1));
+
+    pEvent->pNext = pChaos->pWheel[iLevel][iSlot];
+    pChaos->pWheel[iLevel][iSlot] = pEvent;
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: scheduleChaosEvent
+
+  Summary:   Creates a new event in the timer wheel
+
+  Args:     CHAOS* pChaos
+              Pointer to chaos data
+            ULONGLONG ullTick
+              Planned start in ms after start of chaos mode
+            int iType
+              One of CHAOS_...
+            DWORD dwDuration
+              Duration in ms
+            DWORD dwIntensity
+              Intensity
+
+  Returns:
+
+-----------------------------------------------------------------F-F*/
+void scheduleChaosEvent(CHAOS* pChaos, ULONGLONG ullTick, int iType, DWORD dwDuration, DWORD dwIntensity) {
+    if (ullTick > WHEELMAXTICK) return; // Beyond the range of the timer wheel
+
+    CHAOSEVENT* pEvent = new CHAOSEVENT();
+    pEvent->ullTick = ullTick;
+    pEvent->ullSequence = pChaos->ullSequence++;
+    pEvent->iType = iType;
+    pEvent->dwDuration = dwDuration;
+    pEvent->dwIntensity = dwIntensity;
+    addChaosEvent(pChaos, pEvent);
+    InterlockedIncrement64(&pChaos->llPending);
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: generateChaosEvents
+
+  Summary:   Draws all events until a tick from the seeded generator and schedules
+             the next generation half a horizon before the end. The order of the draws
+             only depends on the seed, but the intensities are scaled with the number of
+             logical processors and the fault intensity. So the same seed creates the same
+             events only with the same chaos.ini, logical processors and fault intensity
+
+  Args:     CHAOS* pChaos
+              Pointer to chaos data
+            ULONGLONG ullUntil
+              Tick in ms
+
+  Returns:
 
-// Global variables
-HINSTANCE g_hInst;
-int g_iFontHeight_96DPI = -12;
-HFONT g_hFont = NULL;
-HWND g_hStatusBar = NULL;
-HANDLE g_semaphore = NULL;
-HWND g_hLastFocus = NULL;
-HWND g_hWnd = NULL;
-BOOL g_registeredForRestart = FALSE;
+-----------------------------------------------------------------F-F*/
+void generateChaosEvents(CHAOS* pChaos, ULONGLONG ullUntil) {
+    for (int i = 0; i < MAXCHAOSTYPES; i++) {
+        CHAOSTYPE* pType = &g_chaosTypes[i];
+        if (pType->dRate <= 0.0) continue;
 
-// Function declarations
-ATOM                MyRegisterClass(HINSTANCE hInstance);
-BOOL                InitInstance(HINSTANCE, int);
-LRESULT CALLBACK    WndProc(HWND, UINT, WPARAM, LPARAM);
+        while (pChaos->ullNextArrival[i] < ullUntil) {
+            DWORD dwDuration = getRandomRange(&pChaos->ullRandom, pType->dwMinDuration, pType->dwMaxDuration);
+            ULONGLONG ullIntensity = getRandomRange(&pChaos->ullRandom, pType->dwMinIntensity, pType->dwMaxIntensity);
 
- /*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
-   Function: MyGetDpiForWindow
+            // Intensities are scaled with the fault intensity, CPU spikes in percent of the logical processors
+            if (i == CHAOS_CPUSPIKE) ullIntensity = max(1ULL, (g_calibration.dwLogicalProcessors * ullIntensity * g_iIntensityPercent + 5000) / 10000);
+            if (i == CHAOS_HANDLEBURST) ullIntensity = (ullIntensity * g_iIntensityPercent + 50) / 100;
 
-   Summary:  Returns the current DPI value for a window
+            scheduleChaosEvent(pChaos, pChaos->ullNextArrival[i], i, dwDuration, (DWORD)ullIntensity);
+            pChaos->ullNextArrival[i] += (ULONGLONG)(getRandomExponential(&pChaos->ullRandom, pType->dRate) * 1000.0);
+        }
+    }
+    scheduleChaosEvent(pChaos, ullUntil - CHAOSHORIZON_MS / 2, CHAOS_GENERATE, 0, 0);
+}
 
-   I had a problem with the built in GetDpiForWindow function.
-   When I use this function and run the program on Windows 2012R2 the program does not start and I will get the message
-   'Der Prozedureinsprungpunkt "GetDpiForWindow" wurde in der DLL "...exe" nicht gefunden. '
-   a.k.a. 'The procedure entry point "GetDpiForWindow" could not be located in the dynamic link library "...exe"'
-   My workaround is MyGetDpiForWindow
-   
-   Args:     WND hWindow
-               Handle to window
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: loadChaosReplay
 
-   Returns:  UINT
-               DPI for window
+  Summary:   Schedules all events of an event log
 
- -----------------------------------------------------------------F-F*/
-UINT MyGetDpiForWindow(HWND hWindow) {
-    UINT uDpi = 96; // Failback value, if GetDpiForWindow could not be used
+  Args:     CHAOS* pChaos
+              Pointer to chaos data
+            const std::wstring& sFile
+              Path of event log
 
-    HMODULE hDLL = GetModuleHandle(L"user32.dll");
-    if (hDLL == NULL)
-        return uDpi;
+  Returns:  BOOL
+              TRUE = success
+              FALSE = file could not be read
 
-    UINT(__stdcall * GetDpiForWindow)(HWND hwnd);
-    *reinterpret_cast<FARPROC*>(&GetDpiForWindow) = GetProcAddress(hDLL, "GetDpiForWindow");
+-----------------------------------------------------------------F-F*/
+BOOL loadChaosReplay(CHAOS* pChaos, const std::wstring& sFile) {
+    HANDLE hFile = CreateFile(sFile.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hFile == INVALID_HANDLE_VALUE) return FALSE;
+
+    std::string sContent;
+    char buffer[4096];
+    DWORD dwRead;
+    while (ReadFile(hFile, buffer, sizeof(buffer), &dwRead, NULL) && (dwRead > 0)) sContent.append(buffer, dwRead);
+    CloseHandle(hFile);
+
+    size_t start = 0;
+    while (start < sContent.length()) {
+        size_t end = sContent.find('\n', start);
+        if (end == std::string::npos) end = sContent.length();
+        std::string sLine(sContent.substr(start, end - start));
+        start = end + 1;
+
+        // Seed from header line, events from lines "tick,start,type,duration,intensity"
+        if (sLine.compare(0, 1, "#") == 0) {
+            sscanf_s(sLine.c_str(), "# appFaults chaos event log, seed %llu", &pChaos->ullSeed);
+            continue;
+        }
+        ULONGLONG ullTick, ullStart;
+        char szType[32];
+        DWORD dwDuration, dwIntensity;
+        if (sscanf_s(sLine.c_str(), "%llu,%llu,%31[^,],%lu,%lu", &ullTick, &ullStart, szType, (unsigned)_countof(szType), &dwDuration, &dwIntensity) != 5) continue;
+
+        std::wstring sType(szType, szType + strlen(szType));
+        for (int i = 0; i < MAXCHAOSTYPES; i++) {
+            if (sType == g_chaosTypes[i].szName) scheduleChaosEvent(pChaos, ullTick, i, dwDuration, dwIntensity);
+        }
+    }
+    return TRUE;
+}
 
-    if (GetDpiForWindow == nullptr)
-        return uDpi;
-    return(GetDpiForWindow(hWindow));
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: freeChaosEvents
+
+  Summary:   Deletes all pending events of the timer wheel
+
+  Args:     CHAOS* pChaos
+              Pointer to chaos data
+
+  Returns:
+
+-----------------------------------------------------------------F-F*/
+void freeChaosEvents(CHAOS* pChaos) {
+    for (int iLevel = 0; iLevel < WHEELLEVELS; iLevel++) {
+        for (int iSlot = 0; iSlot < WHEELSLOTS; iSlot++) {
+            CHAOSEVENT* pEvent = pChaos->pWheel[iLevel][iSlot];
+            while (pEvent != NULL) {
+                CHAOSEVENT* pNext = pEvent->pNext;
+                delete pEvent;
+                pEvent = pNext;
+            }
+            pChaos->pWheel[iLevel][iSlot] = NULL;
+        }
+    }
+    pChaos->llPending = 0;
 }
 
 /*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
-  Function: LoadStringAsWstr
+  Function: threadChaosSpike
 
-  Summary:  Get resource string as wstring
+  Summary:   Faulty thread function, that keeps a logical processor busy for a while
 
-  Args:     HINSTANCE hInstance
-              Handle to instance module
-            UINT uID
-              Resource ID
+  Args:     void* data
+              Duration in ms
 
-  Returns:  std::wstring
+  Returns:  unsigned int
+              0
 
 -----------------------------------------------------------------F-F*/
-std::wstring LoadStringAsWstr(HINSTANCE hInstance, UINT uID) {
-    PCWSTR pws;
-    int cchStringLength = LoadStringW(hInstance, uID, reinterpret_cast<LPWSTR>(&pws), 0);
-    if (cchStringLength > 0) return std::wstring(pws, cchStringLength); else return std::wstring();
+unsigned int __stdcall threadChaosSpike(void* data) {
+    spinNanoseconds((ULONG_PTR)data * 1000000ULL); // Fault
+    return 0;
 }
 
 /*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
-  Function: showProgramInformation
+  Function: threadChaosHandles
 
-  Summary:   Show program information message box
+  Summary:   Faulty thread function, that leaks a number of handles
 
-  Args:     HWND hWindow
-              Handle to main window
+  Args:     void* data
+              Number of handles
+
+  Returns:  unsigned int
+              0
+
+-----------------------------------------------------------------F-F*/
+unsigned int __stdcall threadChaosHandles(void* data) {
+    for (ULONG_PTR i = 0; i < (ULONG_PTR)data; i++) {
+        OpenProcess(PROCESS_ALL_ACCESS, FALSE, GetCurrentProcessId()); // Fault
+    }
+    return 0;
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: fireChaosEvent
+
+  Summary:   Writes an event to the event log and starts the fault.
+             Faults run in own threads or in the GUI thread, so the scheduler is not delayed
+
+  Args:     CHAOS* pChaos
+              Pointer to chaos data
+            CHAOSEVENT* pEvent
+              Pointer to due event
+            ULONGLONG ullNow
+              Current tick in ms
 
   Returns:
 
 -----------------------------------------------------------------F-F*/
-void showProgramInformation(HWND hWindow) {
-    std::wstring sTitle(LoadStringAsWstr(g_hInst, IDS_APP_TITLE));
-    wchar_t szExecutable[MAX_PATH];
-    GetModuleFileName(NULL, szExecutable, MAX_PATH);
+void fireChaosEvent(CHAOS* pChaos, CHAOSEVENT* pEvent, ULONGLONG ullNow) {
+    if (pEvent->iType == CHAOS_GENERATE) {
+        generateChaosEvents(pChaos, pEvent->ullTick + CHAOSHORIZON_MS);
+        return;
+    }
 
-    DWORD  verHandle = 0;
-    UINT   size = 0;
-    LPBYTE lpBuffer = NULL;
-    DWORD  verSize = GetFileVersionInfoSize(szExecutable, NULL);
+    LONG64 llDelay = (LONG64)(ullNow - pEvent->ullTick);
+    if (llDelay > pChaos->llMaxDelay) pChaos->llMaxDelay = llDelay;
+    InterlockedIncrement64(&pChaos->llEvents);
 
-    if (verSize != 0) {
-        BYTE* verData = new BYTE[verSize];
+    if (pChaos->hLog != INVALID_HANDLE_VALUE) {
+        char szLine[MAXCHAOSLOGLINELENGTH + 1];
+        int iLength = _snprintf_s(szLine, MAXCHAOSLOGLINELENGTH + 1, _TRUNCATE, "%llu,%llu,%S,%lu,%lu\r\n",
+            pEvent->ullTick, ullNow, g_chaosTypes[pEvent->iType].szName, pEvent->dwDuration, pEvent->dwIntensity);
+        DWORD dwWritten;
+        if (iLength > 0) WriteFile(pChaos->hLog, szLine, (DWORD)iLength, &dwWritten, NULL);
+    }
 
-        if (GetFileVersionInfo(szExecutable, verHandle, verSize, verData))
-        {
-            if (VerQueryValue(verData, L"\\", (VOID FAR * FAR*) & lpBuffer, &size)) {
-                if (size) {
-                    VS_FIXEDFILEINFO* verInfo = (VS_FIXEDFILEINFO*)lpBuffer;
-                    if (verInfo->dwSignature == 0xfeef04bd) {
-                        sTitle.append(L" ")
-                            .append(std::to_wstring((verInfo->dwFileVersionMS >> 16) & 0xffff))
-                            .append(L".")
-                            .append(std::to_wstring((verInfo->dwFileVersionMS >> 0) & 0xffff))
-                            .append(L".")
-                            .append(std::to_wstring((verInfo->dwFileVersionLS >> 16) & 0xffff))
-                            .append(L".")
-                            .append(std::to_wstring((verInfo->dwFileVersionLS >> 0) & 0xffff));
-                    }
-                }
+    switch (pEvent->iType) {
+        case CHAOS_CPUSPIKE:
+            for (DWORD i = 0; i < pEvent->dwIntensity; i++) {
+                HANDLE hThread = (HANDLE)_beginthreadex(0, 0, &threadChaosSpike, (void*)(ULONG_PTR)pEvent->dwDuration, 0, 0);
+                if (hThread != NULL) CloseHandle(hThread);
             }
+            break;
+        case CHAOS_UISTALL:
+            PostMessage(g_hWnd, WM_CHAOSSTALL, pEvent->dwDuration, 0);
+            break;
+        case CHAOS_HANDLEBURST:
+        {
+            HANDLE hThread = (HANDLE)_beginthreadex(0, 0, &threadChaosHandles, (void*)(ULONG_PTR)pEvent->dwIntensity, 0, 0);
+            if (hThread != NULL) CloseHandle(hThread);
+            break;
         }
-        delete[] verData;
     }
-
-    MessageBox(hWindow, LoadStringAsWstr(g_hInst, IDS_PROGINFO).c_str(), sTitle.c_str(), MB_ICONINFORMATION | MB_OK);
 }
 
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: runChaosWheel
+
+  Summary:   Processes all ticks of the timer wheel until now. When a level wraps around,
+             the events of the current slot of the next level are moved into the lower levels.
+             Events of the same tick are started in the order they were scheduled
+
+  Args:     CHAOS* pChaos
+              Pointer to chaos data
+            ULONGLONG ullNow
+              Current tick in ms
+
+  Returns:
+
+-----------------------------------------------------------------F-F*/
+void runChaosWheel(CHAOS* pChaos, ULONGLONG ullNow) {
+    while (pChaos->ullTick <= ullNow) {
+        for (int iLevel = 1; iLevel < WHEELLEVELS; iLevel++) {
+            if ((pChaos->ullTick & ((1ULL << (WHEELSLOTBITS * iLevel)) - 1)) != 0) break;
+
+            int iSlot = (int)((pChaos->ullTick >> (WHEELSLOTBITS * iLevel)) & (WHEELSLOTS - 1));
+            CHAOSEVENT* pEvent = pChaos->pWheel[iLevel][iSlot];
+            pChaos->pWheel[iLevel][iSlot] = NULL;
+            while (pEvent != NULL) {
+                CHAOSEVENT* pNext = pEvent->pNext;
+                addChaosEvent(pChaos, pEvent);
+                pEvent = pNext;
+            }
+        }
+
+        // Detach due events before the tick is advanced, so new events for this tick go to the next tick
+        int iSlot = (int)(pChaos->ullTick & (WHEELSLOTS - 1));
+        CHAOSEVENT* pDue = pChaos->pWheel[0][iSlot];
+        pChaos->pWheel[0][iSlot] = NULL;
+        pChaos->ullTick++;
+
+        // Sort by sequence (slots are filled in reverse order, so this is mostly O(1) per event)
+        CHAOSEVENT* pSorted = NULL;
+        while (pDue != NULL) {
+            CHAOSEVENT* pNext = pDue->pNext;
+            CHAOSEVENT** ppInsert = &pSorted;
+            while ((*ppInsert != NULL) && ((*ppInsert)->ullSequence < pDue->ullSequence)) ppInsert = &(*ppInsert)->pNext;
+            pDue->pNext = *ppInsert;
+            *ppInsert = pDue;
+            pDue = pNext;
+        }
+
+        while (pSorted != NULL) {
+            CHAOSEVENT* pNext = pSorted->pNext;
+            InterlockedDecrement64(&pChaos->llPending);
+            fireChaosEvent(pChaos, pSorted, ullNow);
+            delete pSorted;
+            pSorted = pNext;
+        }
+    }
+}
 
 /*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
-  Function: threadLoop
+  Function: threadChaos
 
-  Summary:   Faulty thread functions, that runs an endless loop
+  Summary:   Scheduler thread of the chaos mode. Advances the timer wheel every ms
+             until the chaos mode is stopped and reports the result
 
   Args:     void* data
-              Unused
+              Pointer to CHAOS
 
   Returns:  unsigned int
-              0, but never returns
+              0
 
 -----------------------------------------------------------------F-F*/
-unsigned int __stdcall threadLoop(void* data) {
-    while (true);
+unsigned int __stdcall threadChaos(void* data) {
+    CHAOS* pChaos = (CHAOS*)data;
+
+    SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_HIGHEST); // Less delay by CPU spikes
+    timeBeginPeriod(1); // 1 ms resolution for Sleep
+
+    ULONGLONG ullStart = getNanoseconds();
+    while (!pChaos->lStop) {
+        runChaosWheel(pChaos, (getNanoseconds() - ullStart) / 1000000ULL);
+        Sleep(1);
+    }
+
+    timeEndPeriod(1);
+    freeChaosEvents(pChaos);
+    if (pChaos->hLog != INVALID_HANDLE_VALUE) CloseHandle(pChaos->hLog);
+
+    #define MAXCHAOSRESULTLENGTH 1023
+    wchar_t szResult[MAXCHAOSRESULTLENGTH + 1];
+    _snwprintf_s(szResult, MAXCHAOSRESULTLENGTH + 1, _TRUNCATE, LoadStringAsWstr(g_hInst, IDS_CHAOSRESULT).c_str(),
+        pChaos->ullSeed,
+        pChaos->llEvents,
+        pChaos->llMaxDelay,
+        pChaos->sLogFile.c_str(),
+        CHAOSREPLAYPARAMETER,
+        pChaos->sLogFile.c_str());
+    PostMessage(g_hWnd, WM_FAULTREPORT, IDS_CHAOS, (LPARAM)new std::wstring(szResult));
+
+    InterlockedExchange(&pChaos->lFinished, 1);
     return 0;
 }
 
 /*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
-  Function: threadWaitForever
+  Function: startChaos
 
-  Summary:   Faulty thread functions, that waits forever 
+  Summary:   Starts the chaos mode with events from the seed or from an event log
 
-  Args:     void* data
-              Unused
+  Args:
 
-  Returns:  unsigned int
-              0, but never returns
+  Returns:  CHAOS*
+              Pointer to chaos data
+              NULL = error
 
 -----------------------------------------------------------------F-F*/
-unsigned int __stdcall threadWaitForever(void* data) {
-    WaitForSingleObject(g_semaphore, INFINITE);
-    return 0;
+CHAOS* startChaos() {
+    CHAOS* pChaos = new CHAOS();
+    pChaos->hLog = INVALID_HANDLE_VALUE;
+
+    wchar_t szTempPath[MAX_PATH];
+    if (GetTempPath(MAX_PATH, szTempPath) == 0) szTempPath[0] = L'\0';
+
+    if (!g_sChaosReplayFile.empty()) {
+        if (!loadChaosReplay(pChaos, g_sChaosReplayFile)) {
+            delete pChaos;
+            return NULL;
+        }
+        pChaos->sLogFile = std::wstring(szTempPath).append(L"appFaults_chaos_replay_").append(std::to_wstring(GetCurrentProcessId())).append(L".csv");
+    } else {
+        loadChaosSettings();
+        pChaos->ullSeed = g_chaosSeed ? g_ullChaosSeed : (getNanoseconds() ^ ((ULONGLONG)GetCurrentProcessId() << 32));
+        pChaos->ullRandom = pChaos->ullSeed;
+        for (int i = 0; i < MAXCHAOSTYPES; i++) {
+            if (g_chaosTypes[i].dRate > 0.0) pChaos->ullNextArrival[i] = (ULONGLONG)(getRandomExponential(&pChaos->ullRandom, g_chaosTypes[i].dRate) * 1000.0);
+        }
+        generateChaosEvents(pChaos, CHAOSHORIZON_MS);
+        pChaos->sLogFile = std::wstring(szTempPath).append(L"appFaults_chaos_").append(std::to_wstring(pChaos->ullSeed)).append(L".csv");
+    }
+
+    pChaos->hLog = CreateFile(pChaos->sLogFile.c_str(), GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (pChaos->hLog != INVALID_HANDLE_VALUE) {
+        char szHeader[2 * MAXCHAOSLOGLINELENGTH + 1]; // Two lines
+        int iLength = _snprintf_s(szHeader, 2 * MAXCHAOSLOGLINELENGTH + 1, _TRUNCATE,
+            "# appFaults chaos event log, seed %llu, logical processors %lu, intensity %d%%\r\n# tick_ms,start_ms,type,duration_ms,intensity\r\n",
+            pChaos->ullSeed, g_calibration.dwLogicalProcessors, g_iIntensityPercent);
+        DWORD dwWritten;
+        if (iLength > 0) WriteFile(pChaos->hLog, szHeader, (DWORD)iLength, &dwWritten, NULL);
+    }
+
+    HANDLE hThread = (HANDLE)_beginthreadex(0, 0, &threadChaos, (void*)pChaos, 0, 0);
+    if (hThread == NULL) {
+        freeChaosEvents(pChaos);
+        if (pChaos->hLog != INVALID_HANDLE_VALUE) CloseHandle(pChaos->hLog);
+        delete pChaos;
+        return NULL;
+    }
+    CloseHandle(hThread);
+    return pChaos;
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: updateChaosStatus
+
+  Summary:   Shows the state of the chaos mode in the metrics panel
+
+  Args:
+
+  Returns:
+
+-----------------------------------------------------------------F-F*/
+void updateChaosStatus() {
+    if ((g_pChaos == NULL) || g_pChaos->lFinished) {
+        setMetrics(METRICS_CHAOS, L"");
+        return;
+    }
+
+    #define MAXCHAOSSTATUSLENGTH 255
+    wchar_t szStatus[MAXCHAOSSTATUSLENGTH + 1];
+    _snwprintf_s(szStatus, MAXCHAOSSTATUSLENGTH + 1, _TRUNCATE, LoadStringAsWstr(g_hInst, IDS_CHAOSSTATUS).c_str(),
+        g_pChaos->ullSeed,
+        g_pChaos->llEvents,
+        g_pChaos->llPending,
+        g_pChaos->llMaxDelay);
+    setMetrics(METRICS_CHAOS, szStatus);
 }
 
 /*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
@@ -288,6 +3176,11 @@ void resizeControls(HWND hWindow) {
     ncm.cbSize = sizeof(NONCLIENTMETRICS);
     SystemParametersInfo(SPI_GETNONCLIENTMETRICS, sizeof(NONCLIENTMETRICS), &ncm, 0);
 
+    // Metrics panel uses the unscaled menu font to fit the long lines
+    ncm.lfMenuFont.lfHeight = MulDiv(g_iFontHeight_96DPI, uDpi, USER_DEFAULT_SCREEN_DPI);
+    if (g_hMetricsFont != NULL) DeleteObject(g_hMetricsFont); // Prevents GDI leak
+    g_hMetricsFont = CreateFontIndirect(&ncm.lfMenuFont);
+
     // Scale font size to x1.5 (I am getting old...)
     ncm.lfMenuFont.lfHeight = 3 * MulDiv(g_iFontHeight_96DPI, uDpi, USER_DEFAULT_SCREEN_DPI) / 2;
 
@@ -302,13 +3195,27 @@ void resizeControls(HWND hWindow) {
     GetClientRect(g_hStatusBar, &rectStatusBar);
     int iStatusBarHeight = rectStatusBar.bottom;
 
-    // Resize automatically generated buttons
+    // Get height of metrics panel
+    TEXTMETRIC tm{};
+    HDC hDC = GetDC(hWindow);
+    if (hDC != NULL) {
+        HGDIOBJ hOldFont = SelectObject(hDC, g_hMetricsFont);
+        GetTextMetrics(hDC, &tm);
+        SelectObject(hDC, hOldFont);
+        ReleaseDC(hWindow, hDC);
+    }
+    int iMetricsHeight = MAXMETRICS * (tm.tmHeight + tm.tmExternalLeading);
+
+    // Resize automatically generated buttons, column by column
+    int iButtonsHeight = iClientHeight - iStatusBarHeight - iMetricsHeight;
     int iButtonHeight_96DPI = MulDiv(HIWORD(units), 14, 8);
-    int iMargin = ((iClientHeight - iStatusBarHeight) 
-        - MAXAUTOBUTTONS * MulDiv(iButtonHeight_96DPI, uDpi, USER_DEFAULT_SCREEN_DPI))
-        / (MAXAUTOBUTTONS + 1);
-    int iPosY = iMargin + (iClientHeight - iStatusBarHeight -
-        (MAXAUTOBUTTONS * (iMargin + MulDiv(iButtonHeight_96DPI, uDpi, USER_DEFAULT_SCREEN_DPI)) + iMargin)) / 2;
+    int iButtonHeight = MulDiv(iButtonHeight_96DPI, uDpi, USER_DEFAULT_SCREEN_DPI);
+    int iMargin = (iButtonsHeight
+        - AUTOBUTTONROWS * iButtonHeight)
+        / (AUTOBUTTONROWS + 1);
+    int iTop = iMargin + (iButtonsHeight -
+        (AUTOBUTTONROWS * (iMargin + iButtonHeight) + iMargin)) / 2;
+    int iButtonWidth = (iClientWidth - iMargin * (AUTOBUTTONCOLUMNS + 1)) / AUTOBUTTONCOLUMNS;
     for (int i = 0; i < MAXAUTOBUTTONS; i++) {
         HWND hButton = GetDlgItem(hWindow, (int) g_autoButtons[i].dwResourceID);
         if (hButton != NULL) {
@@ -316,15 +3223,25 @@ void resizeControls(HWND hWindow) {
             SendMessage(hButton, WM_SETFONT, (WPARAM)g_hFont, MAKELPARAM(TRUE, 0));
             // Set size for button
             SetWindowPos(hButton, 0,
-                iMargin,
-                iPosY,
-                iClientWidth - iMargin * 2,
-                MulDiv(iButtonHeight_96DPI, uDpi, USER_DEFAULT_SCREEN_DPI) ,
+                iMargin + (i / AUTOBUTTONROWS) * (iMargin + iButtonWidth),
+                iTop + (i % AUTOBUTTONROWS) * (iMargin + iButtonHeight),
+                iButtonWidth,
+                iButtonHeight,
                 SWP_NOZORDER);
-            iPosY += iMargin + MulDiv(iButtonHeight_96DPI, uDpi, USER_DEFAULT_SCREEN_DPI);
         }
     }
 
+    // Resize metrics panel between buttons and status bar
+    if (g_hMetrics != NULL) {
+        SendMessage(g_hMetrics, WM_SETFONT, (WPARAM)g_hMetricsFont, MAKELPARAM(TRUE, 0));
+        SetWindowPos(g_hMetrics, 0,
+            iMargin,
+            iButtonsHeight,
+            iClientWidth - iMargin * 2,
+            iMetricsHeight,
+            SWP_NOZORDER);
+    }
+
     // Set width of left and right side of statusbar
     int statwidths[2];
     statwidths[0] = 3* iClientWidth/4;
@@ -374,6 +3291,16 @@ void createControls(HWND hWindow)
             }
         }
     }
+    // Metrics panel for job object, network and chaos mode
+    g_hMetrics = CreateWindow(
+        L"STATIC",
+        NULL,
+        WS_VISIBLE | WS_CHILD | SS_LEFT | SS_NOPREFIX,
+        0, 0, 0, 0, // Size will be set later
+        hWindow,
+        (HMENU)IDC_METRICS,
+        g_hInst,
+        NULL);
     // Status bar
     g_hStatusBar = CreateWindow(
         STATUSCLASSNAME,
@@ -393,6 +3320,24 @@ void createControls(HWND hWindow)
     if (hSysMenu != NULL) {
         InsertMenu(hSysMenu, -1, MF_BYPOSITION, MF_SEPARATOR, NULL); // Seperator
         InsertMenu(hSysMenu, -1, MF_BYPOSITION | MF_STRING | (g_registeredForRestart ? MF_CHECKED : 0), (UINT)IDM_REGISTERRESTART, LoadStringAsWstr(g_hInst, IDS_REGISTERRESTART).c_str()); // Register for restart
+        InsertMenu(hSysMenu, -1, MF_BYPOSITION | MF_STRING | (g_runFaultsInJob ? MF_CHECKED : 0), (UINT)IDM_JOBOBJECT, LoadStringAsWstr(g_hInst, IDS_JOBOBJECT).c_str()); // Run faults in job object
+        InsertMenu(hSysMenu, -1, MF_BYPOSITION | MF_STRING | (g_allocInstrumentation ? MF_CHECKED : 0), (UINT)IDM_ALLOCINSTRUMENTATION, LoadStringAsWstr(g_hInst, IDS_ALLOCINSTRUMENTATION).c_str()); // Allocation instrumentation
+        InsertMenu(hSysMenu, -1, MF_BYPOSITION, (UINT)IDM_ALLOCSTATISTICS, LoadStringAsWstr(g_hInst, IDS_ALLOCSTATISTICS).c_str()); // Allocation statistics
+
+        // Submenu for fault intensity
+        HMENU hIntensityMenu = CreatePopupMenu();
+        if (hIntensityMenu != NULL) {
+            for (UINT uID = IDM_INTENSITY25; uID <= IDM_INTENSITY100; uID++) {
+                #define MAXINTENSITYLENGTH 63
+                wchar_t szIntensity[MAXINTENSITYLENGTH + 1];
+                _snwprintf_s(szIntensity, MAXINTENSITYLENGTH + 1, _TRUNCATE, LoadStringAsWstr(g_hInst, IDS_INTENSITYFORMAT).c_str(), 25 * (uID - IDM_INTENSITY25 + 1));
+                AppendMenu(hIntensityMenu, MF_STRING, uID, szIntensity);
+            }
+            if (g_iIntensityPercent % 25 == 0) // Other values are only possible with the command line parameter
+                CheckMenuRadioItem(hIntensityMenu, IDM_INTENSITY25, IDM_INTENSITY100, IDM_INTENSITY25 + g_iIntensityPercent / 25 - 1, MF_BYCOMMAND);
+            InsertMenu(hSysMenu, -1, MF_BYPOSITION | MF_POPUP, (UINT_PTR)hIntensityMenu, LoadStringAsWstr(g_hInst, IDS_INTENSITY).c_str()); // Fault intensity
+        }
+        InsertMenu(hSysMenu, -1, MF_BYPOSITION, (UINT)IDM_CALIBRATION, LoadStringAsWstr(g_hInst, IDS_CALIBRATION).c_str()); // Calibration
         InsertMenu(hSysMenu, -1, MF_BYPOSITION, (UINT)IDM_ABOUT, LoadStringAsWstr(g_hInst, IDS_ABOUT).c_str()); // About
     }
 }
@@ -427,8 +3372,61 @@ int APIENTRY wWinMain(_In_ HINSTANCE hInstance,
     // Enables controls from Comctl32.dll, like status bar ...
     InitCommonControls();
 
-    // Start task manager as a usefull tool
-    ShellExecute(NULL, L"open", L"taskmgr.exe", NULL, NULL, SW_SHOWNORMAL);
+    // Frequency for high resolution timestamps
+    QueryPerformanceFrequency(&g_liPerformanceFrequency);
+
+    // Check for command line parameters /fault:<ID>, /netmessagesize:<bytes>, /netbatch:<messages>, /allocinstrumentation,
+    // /allocinject:<process ID>, /intensity:<percent>, /chaosseed:<number> and /chaosreplay:<event log>
+    int iArgs = 0;
+    LPWSTR* pszArgs = CommandLineToArgvW(GetCommandLineW(), &iArgs);
+    if (pszArgs != NULL) {
+        for (int i = 1; i < iArgs; i++) {
+            if (_wcsnicmp(pszArgs[i], FAULTPARAMETER, wcslen(FAULTPARAMETER)) == 0)
+                g_uStartFault = (UINT)_wtoi(pszArgs[i] + wcslen(FAULTPARAMETER));
+            if (_wcsnicmp(pszArgs[i], NETMESSAGESIZEPARAMETER, wcslen(NETMESSAGESIZEPARAMETER)) == 0)
+                g_dwNetMessageSize = (DWORD)max(1, min(NETMAXMESSAGESIZE, _wtoi(pszArgs[i] + wcslen(NETMESSAGESIZEPARAMETER))));
+            if (_wcsnicmp(pszArgs[i], NETBATCHPARAMETER, wcslen(NETBATCHPARAMETER)) == 0)
+                g_dwNetBatch = (DWORD)max(1, min(NETMAXBATCH, _wtoi(pszArgs[i] + wcslen(NETBATCHPARAMETER))));
+            if (_wcsicmp(pszArgs[i], ALLOCPARAMETER) == 0)
+                g_allocInstrumentation = TRUE;
+            if (_wcsnicmp(pszArgs[i], ALLOCINJECTPARAMETER, wcslen(ALLOCINJECTPARAMETER)) == 0)
+                g_dwAllocInjectProcessId = wcstoul(pszArgs[i] + wcslen(ALLOCINJECTPARAMETER), NULL, 10);
+            if (_wcsnicmp(pszArgs[i], INTENSITYPARAMETER, wcslen(INTENSITYPARAMETER)) == 0)
+                g_iIntensityPercent = max(1, min(100, _wtoi(pszArgs[i] + wcslen(INTENSITYPARAMETER))));
+            if (_wcsnicmp(pszArgs[i], CHAOSSEEDPARAMETER, wcslen(CHAOSSEEDPARAMETER)) == 0) {
+                g_ullChaosSeed = _wcstoui64(pszArgs[i] + wcslen(CHAOSSEEDPARAMETER), NULL, 10);
+                g_chaosSeed = TRUE;
+            }
+            if (_wcsnicmp(pszArgs[i], CHAOSREPLAYPARAMETER, wcslen(CHAOSREPLAYPARAMETER)) == 0)
+                g_sChaosReplayFile = pszArgs[i] + wcslen(CHAOSREPLAYPARAMETER);
+        }
+        LocalFree(pszArgs);
+    }
+
+    // Load the allocation instrumentation into another process and exit without GUI
+    if (g_dwAllocInjectProcessId != 0) {
+        #define MAXALLOCINJECTLENGTH 255
+        wchar_t szResult[MAXALLOCINJECTLENGTH + 1];
+        DWORD dwError = injectAllocationHook(g_dwAllocInjectProcessId);
+        if (dwError == ERROR_SUCCESS) {
+            wchar_t szTempPath[MAX_PATH];
+            if (GetTempPath(MAX_PATH, szTempPath) == 0) szTempPath[0] = L'\0';
+            _snwprintf_s(szResult, MAXALLOCINJECTLENGTH + 1, _TRUNCATE, LoadStringAsWstr(hInstance, IDS_ALLOCINJECTED).c_str(), g_dwAllocInjectProcessId);
+            std::wstring sResult(szResult);
+            sResult.append(L"\n").append(szTempPath).append(L"appFaults_alloc_").append(std::to_wstring(g_dwAllocInjectProcessId)).append(L".txt");
+            MessageBox(NULL, sResult.c_str(), LoadStringAsWstr(hInstance, IDS_ALLOCINJECT).c_str(), MB_ICONINFORMATION | MB_OK);
+            return 0;
+        }
+        _snwprintf_s(szResult, MAXALLOCINJECTLENGTH + 1, _TRUNCATE, LoadStringAsWstr(hInstance, IDS_ALLOCINJECTFAILED).c_str(), g_dwAllocInjectProcessId, dwError);
+        MessageBox(NULL, szResult, LoadStringAsWstr(hInstance, IDS_ALLOCINJECT).c_str(), MB_ICONERROR | MB_OK);
+        return 1;
+    }
+
+    // Capacity of the machine for fault intensity from cache. A new calibration runs after the start of the GUI
+    BOOL bCalibrated = loadCalibration();
+
+    // Start task manager as a usefull tool (not for child processes in a job object)
+    if (g_uStartFault == 0) ShellExecute(NULL, L"open", L"taskmgr.exe", NULL, NULL, SW_SHOWNORMAL);
 
     // New semaphore with inital value of 0 (used tp create hanging threads)
     g_semaphore = CreateSemaphore(NULL, 0, 1, NULL);
@@ -436,6 +3434,9 @@ int APIENTRY wWinMain(_In_ HINSTANCE hInstance,
     // Init application
     if (!InitInstance (hInstance, nCmdShow)) return 1;
 
+    // Allocation instrumentation and requested fault need the calibration
+    if (bCalibrated) finishStartup(); else startCalibration(FALSE);
+
     MSG msg;
 
     // Message loop
@@ -451,7 +3452,9 @@ int APIENTRY wWinMain(_In_ HINSTANCE hInstance,
 
     // Cleanup
     DeleteObject(g_hFont);
+    DeleteObject(g_hMetricsFont);
     CloseHandle(g_semaphore);
+    if (g_hJob != NULL) CloseHandle(g_hJob); // Kills all faults in job object
 
     return (int) msg.wParam;
 }
@@ -509,9 +3512,13 @@ BOOL InitInstance(HINSTANCE hInstance, int nCmdShow)
 {
    g_hInst = hInstance;
 
+   // Mark child processes for faults in a job object
+   std::wstring sTitle(LoadStringAsWstr(g_hInst, IDS_APP_TITLE));
+   if (g_uStartFault != 0) sTitle.append(L" - ").append(LoadStringAsWstr(g_hInst, IDS_JOBOBJECTCHILD));
+
    g_hWnd = CreateWindowW(
        L"MainWndClass",
-       LoadStringAsWstr(g_hInst, IDS_APP_TITLE).c_str(),
+       sTitle.c_str(),
        WS_OVERLAPPED|WS_CAPTION|WS_SYSMENU|WS_MINIMIZEBOX, 
        CW_USEDEFAULT, 
        CW_USEDEFAULT, 
@@ -572,6 +3579,61 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
                     UnregisterApplicationRestart();
                 break;
             }
+            case IDM_JOBOBJECT: // Toogle faults in job object
+            {
+                g_runFaultsInJob = !g_runFaultsInJob;
+
+                // Sysmenu entry
+                HMENU hSysMenu = GetSystemMenu(hWnd, FALSE);
+                if (hSysMenu != NULL) {
+                    ModifyMenu(hSysMenu, IDM_JOBOBJECT, MF_BYCOMMAND | MF_STRING | (g_runFaultsInJob ? MF_CHECKED : 0), (UINT)IDM_JOBOBJECT, LoadStringAsWstr(g_hInst, IDS_JOBOBJECT).c_str()); // Run faults in job object
+                }
+                break;
+            }
+            case IDM_ALLOCINSTRUMENTATION: // Toogle allocation instrumentation
+            {
+                if (g_calibrationRunning) { // Instrumentation is enabled after the calibration at program start
+                    SendMessage(g_hStatusBar, SB_SETTEXT, 0, (LPARAM)LoadStringAsWstr(g_hInst, IDS_CALIBRATIONRUNNING).c_str());
+                    break;
+                }
+                setAllocationInstrumentation(!g_allocInstrumentation);
+
+                // Sysmenu entry
+                HMENU hSysMenu = GetSystemMenu(hWnd, FALSE);
+                if (hSysMenu != NULL) {
+                    ModifyMenu(hSysMenu, IDM_ALLOCINSTRUMENTATION, MF_BYCOMMAND | MF_STRING | (g_allocInstrumentation ? MF_CHECKED : 0), (UINT)IDM_ALLOCINSTRUMENTATION, LoadStringAsWstr(g_hInst, IDS_ALLOCINSTRUMENTATION).c_str()); // Allocation instrumentation
+                }
+                break;
+            }
+            case IDM_INTENSITY25:
+            case IDM_INTENSITY50:
+            case IDM_INTENSITY75:
+            case IDM_INTENSITY100:
+                setIntensity(hWnd, (UINT)wParam);
+                break;
+            case IDM_CALIBRATION:
+                if (g_calibrationRunning) {
+                    SendMessage(g_hStatusBar, SB_SETTEXT, 0, (LPARAM)LoadStringAsWstr(g_hInst, IDS_CALIBRATIONRUNNING).c_str());
+                    break;
+                }
+                if (g_allocInstrumentation) { // The hooks would slow down the measured malloc/free
+                    MessageBox(hWnd,
+                        getCalibrationReport().append(L"\n\n").append(LoadStringAsWstr(g_hInst, IDS_CALIBRATIONINSTRUMENTED)).c_str(),
+                        LoadStringAsWstr(g_hInst, IDS_CALIBRATION).c_str(),
+                        MB_ICONINFORMATION | MB_OK);
+                    break;
+                }
+                if (MessageBox(hWnd,
+                    getCalibrationReport().append(L"\n\n").append(LoadStringAsWstr(g_hInst, IDS_RECALIBRATE)).c_str(),
+                    LoadStringAsWstr(g_hInst, IDS_CALIBRATION).c_str(),
+                    MB_YESNO | MB_ICONQUESTION) == IDYES) startCalibration(TRUE);
+                break;
+            case IDM_ALLOCSTATISTICS:
+                if (g_allocInstrumentation)
+                    MessageBox(hWnd, getAllocationReport().c_str(), LoadStringAsWstr(g_hInst, IDS_ALLOCSTATISTICS).c_str(), MB_ICONINFORMATION | MB_OK);
+                else
+                    MessageBox(hWnd, LoadStringAsWstr(g_hInst, IDS_ALLOCNOTACTIVE).c_str(), LoadStringAsWstr(g_hInst, IDS_ALLOCSTATISTICS).c_str(), MB_ICONINFORMATION | MB_OK);
+                break;
             default:
                 return DefWindowProc(hWnd, message, wParam, lParam);
         }
@@ -584,6 +3646,22 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
         break;
     case WM_COMMAND:
         {
+            // Run fault in a child process in the job object (a running chaos mode is stopped where it runs)
+            BOOL bChaosRunning = (g_pChaos != NULL) && !g_pChaos->lFinished;
+            if (g_runFaultsInJob && isAutoButton(LOWORD(wParam)) && !((LOWORD(wParam) == IDM_CHAOS) && bChaosRunning)) {
+                if (LOWORD(wParam) == IDM_CHAOS) {
+                    if (toggleChaosChild()) break; // Further clicks
+                    g_dwChaosChildProcessId = startFaultInJob(LOWORD(wParam));
+                } else startFaultInJob(LOWORD(wParam));
+                break;
+            }
+
+            // Rate limits of the faults need the calibration
+            if (g_calibrationRunning && isAutoButton(LOWORD(wParam))) {
+                SendMessage(g_hStatusBar, SB_SETTEXT, 0, (LPARAM)LoadStringAsWstr(g_hInst, IDS_CALIBRATIONRUNNING).c_str());
+                break;
+            }
+
             switch (LOWORD(wParam))
             {
                 case IDM_LOOP:
@@ -597,9 +3675,44 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
                         .append(L" ")
                         .append(LoadStringAsWstr(g_hInst, IDS_LOOPTHREADS)).c_str());
                     break;
+                case IDM_CPULOAD:
+                {
+                    // Fault intensity in percent of all cores, one thread per core (spread over the NUMA nodes)
+                    DWORD dwCores = (g_calibration.dwCores > 0) ? g_calibration.dwCores : g_calibration.dwLogicalProcessors;
+                    DWORD dwThreads = max(1UL, (dwCores * g_iIntensityPercent + 50) / 100);
+                    for (DWORD i = 0; i < dwThreads; i++) {
+                        HANDLE hThread = startThreadOnCore(&threadLoop, (void*)hWnd, i); // Fault
+                        if (hThread != NULL) CloseHandle(hThread);
+                        iThreadCount++;
+                    }
+                    SendMessage(g_hStatusBar, SB_SETTEXT, 0,
+                        (LPARAM)std::wstring(std::to_wstring(iThreadCount))
+                        .append(L" ")
+                        .append(LoadStringAsWstr(g_hInst, IDS_LOOPTHREADS)).c_str());
+                    break;
+                }
+                case IDM_MEMORYBANDWIDTH:
+                    if (g_lMemoryBandwidthThreads > 0) { // Second click stops the threads
+                        InterlockedExchange(&g_lMemoryBandwidthStop, 1);
+                        break;
+                    }
+                    InterlockedExchange(&g_lMemoryBandwidthStop, 0);
+                    for (DWORD i = 0; i < getBandwidthThreads(); i++) {
+                        InterlockedIncrement(&g_lMemoryBandwidthThreads);
+                        HANDLE hThread = startThreadOnCore(&threadMemoryBandwidth, NULL, i); // Fault
+                        if (hThread != NULL) CloseHandle(hThread); else InterlockedDecrement(&g_lMemoryBandwidthThreads);
+                    }
+                    break;
                 case IDM_THREADSPAM:
-                    while (true) _beginthreadex(0, 0, &threadWaitForever, (void*)hWnd, 0, 0); // Fault
+                {
+                    RATELIMIT limit;
+                    initRateLimit(&limit, g_calibration.dThreadsPerSecond);
+                    while (true) {
+                        _beginthreadex(0, 0, &threadWaitForever, (void*)hWnd, 0, 0); // Fault
+                        waitRateLimit(&limit);
+                    }
                     break;
+                }
                 case IDM_DEADLOCK:
                     WaitForSingleObject(g_semaphore, INFINITE); // Fault
                     break;
@@ -635,6 +3748,52 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
 
                     break;
                 }
+                case IDM_PRIORITYINVERSION:
+                    if (InterlockedCompareExchange(&g_lPriorityInversionRunning, 1, 0) == 0) {
+                        SendMessage(g_hStatusBar, SB_SETTEXT, 0, (LPARAM)LoadStringAsWstr(g_hInst, IDS_PRIORITYINVERSIONRUNNING).c_str());
+                        HANDLE hThread = (HANDLE)_beginthreadex(0, 0, &threadPriorityInversion, (void*)hWnd, 0, 0); // Fault
+                        if (hThread != NULL) CloseHandle(hThread); else InterlockedExchange(&g_lPriorityInversionRunning, 0);
+                    }
+                    break;
+                case IDM_NETCHURN:
+                case IDM_NETTHROUGHPUT:
+                case IDM_SOCKETLEAK:
+                {
+                    // Only one network mode at the same time. Any network button stops the running mode
+                    if ((g_pNetwork != NULL) && !g_pNetwork->lFinished) {
+                        stopNetwork(g_pNetwork);
+                        break;
+                    }
+                    deleteNetwork(g_pNetwork);
+                    g_pNetwork = NULL;
+                    NETWORK* pNetwork = new NETWORK();
+                    if (LOWORD(wParam) == IDM_NETCHURN) pNetwork->iMode = NETMODE_CHURN;
+                    else if (LOWORD(wParam) == IDM_NETTHROUGHPUT) pNetwork->iMode = NETMODE_THROUGHPUT;
+                    else pNetwork->iMode = NETMODE_SOCKETLEAK;
+                    pNetwork->listenSocket = INVALID_SOCKET;
+                    pNetwork->pMessage = new char[g_dwNetMessageSize]();
+                    HANDLE hThread = (HANDLE)_beginthreadex(0, 0, &threadNetwork, (void*)pNetwork, 0, 0); // Fault
+                    if (hThread != NULL) {
+                        CloseHandle(hThread);
+                        g_pNetwork = pNetwork;
+                    } else {
+                        deleteNetwork(pNetwork);
+                    }
+                    break;
+                }
+                case IDM_CHAOS:
+                    if ((g_pChaos != NULL) && !g_pChaos->lFinished) { // Second click stops the chaos mode
+                        InterlockedExchange(&g_pChaos->lStop, 1);
+                        break;
+                    }
+                    delete g_pChaos;
+                    g_pChaos = startChaos(); // Fault
+                    if ((g_pChaos == NULL) && !g_sChaosReplayFile.empty())
+                        MessageBox(hWnd,
+                            LoadStringAsWstr(g_hInst, IDS_CHAOSREPLAYERROR).append(L"\n").append(g_sChaosReplayFile).c_str(),
+                            LoadStringAsWstr(g_hInst, IDS_CHAOS).c_str(),
+                            MB_ICONERROR | MB_OK);
+                    break;
                 case IDM_LOCK10S:
                     Sleep(60000); // Fault
                     break;
@@ -643,7 +3802,12 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
                         LoadStringAsWstr(g_hInst, IDS_MEMORYLEAKWARING).c_str(),
                         LoadStringAsWstr(g_hInst, IDS_MEMORYLEAK).c_str(),
                         MB_YESNO | MB_ICONQUESTION | MB_APPLMODAL) == IDYES) {
-                        while (true) HWND* phWindow = (HWND*)malloc(sizeof(HWND)); // Fault
+                        RATELIMIT limit;
+                        initRateLimit(&limit, g_calibration.dAllocationsPerSecond);
+                        while (true) {
+                            HWND* phWindow = (HWND*)malloc(sizeof(HWND)); // Fault
+                            waitRateLimit(&limit);
+                        }
                     }
                     break;
                 case IDM_NULLACCESS:
@@ -651,8 +3815,15 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
                     pszTest[0] = ' '; // Fault
                     break;
                 case IDM_HANDLELEAK:
-                    while (true) OpenProcess(PROCESS_ALL_ACCESS, FALSE, GetCurrentProcessId()); // Fault
+                {
+                    RATELIMIT limit;
+                    initRateLimit(&limit, g_calibration.dHandlesPerSecond);
+                    while (true) {
+                        OpenProcess(PROCESS_ALL_ACCESS, FALSE, GetCurrentProcessId()); // Fault
+                        waitRateLimit(&limit);
+                    }
                     break;
+                }
                 case IDM_FREEINVALID:
                     pszTest = (char*)malloc(sizeof(char));
                     free(pszTest);
@@ -679,6 +3850,39 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
         resizeWindow(hWnd,(RECT*)lParam);
         resizeControls(hWnd);
         break;
+    case WM_FAULTREPORT:
+    {
+        std::wstring* psReport = (std::wstring*)lParam;
+        SendMessage(g_hStatusBar, SB_SETTEXT, 0, (LPARAM)LoadStringAsWstr(g_hInst, IDS_APPWARNING).c_str());
+        MessageBox(hWnd, psReport->c_str(), LoadStringAsWstr(g_hInst, (UINT)wParam).c_str(), MB_ICONINFORMATION | MB_OK);
+        delete psReport;
+        break;
+    }
+    case WM_CHAOSSTALL:
+        Sleep((DWORD)wParam); // Fault
+        break;
+    case WM_CALIBRATIONDONE:
+    {
+        CALIBRATION* pCalibration = (CALIBRATION*)lParam;
+        g_calibration = *pCalibration;
+        delete pCalibration;
+        g_calibrationRunning = FALSE;
+        saveCalibration();
+        SendMessage(g_hStatusBar, SB_SETTEXT, 0, (LPARAM)LoadStringAsWstr(g_hInst, IDS_APPWARNING).c_str());
+        if (wParam) MessageBox(hWnd, getCalibrationReport().c_str(), LoadStringAsWstr(g_hInst, IDS_CALIBRATION).c_str(), MB_ICONINFORMATION | MB_OK);
+        else finishStartup();
+        break;
+    }
+    case WM_CHAOSSTOP:
+        if ((g_pChaos != NULL) && !g_pChaos->lFinished && (InterlockedExchange(&g_pChaos->lStop, 1) == 0)) return 1;
+        return 0;
+    case WM_CTLCOLORSTATIC:
+        if ((HWND)lParam == g_hMetrics) { // Metrics panel on window background
+            SetBkMode((HDC)wParam, TRANSPARENT);
+            SetTextColor((HDC)wParam, RGB(255, 255, 255));
+            return (LRESULT)GetClassLongPtr(hWnd, GCLP_HBRBACKGROUND);
+        }
+        return DefWindowProc(hWnd, message, wParam, lParam);
     case WM_DESTROY:
         PostQuitMessage(0);
         break;
@@ -694,6 +3898,10 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
                 _snwprintf_s(szTime, MAXTIMELENGTH + 1, _TRUNCATE, L"\t%02i:%02i:%02i", lt.wHour, lt.wMinute, lt.wSecond);
 
                 SendMessage(g_hStatusBar, SB_SETTEXT, 1, (LPARAM)szTime);
+
+                updateJobStatus();
+                updateNetworkStatus();
+                updateChaosStatus();
                 break;
             }
         }
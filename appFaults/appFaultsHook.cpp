@@ -0,0 +1,86 @@
+/*+===================================================================
+  File:      appFaultsHook.cpp
+
+  Summary:   DLL with the allocation instrumentation of appFaults for other processes.
+             appFaults.exe /allocinject:<process ID> loads this DLL into a running
+             process. The DLL replaces the heap functions in the import address tables
+             of the process and writes the allocation statistics every second to
+             %TEMP%\appFaults_alloc_<process ID>.txt
+             The DLL stays loaded until the process ends
+             Use at your own risk!
+
+  License: CC0
+  Copyright (c) 2024 codingABI
+
+  History:
+  20261019, Initial version
+
+===================================================================+*/
+
+#include "framework.h"
+#include "resource.h"
+#include "allocation.h"
+
+// Program with the string resources (same directory as this DLL)
+#define RESOURCEPROGRAM L"appFaults.exe"
+
+// Global variables
+HINSTANCE g_hInst = NULL;
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: threadStartInstrumentation
+
+  Summary:   Loads the string resources of appFaults.exe and enables the
+             allocation instrumentation. Runs outside of DllMain, because the
+             overhead measurement waits for other threads
+
+  Args:     LPVOID data
+              Handle of this DLL
+
+  Returns:  DWORD
+              0
+
+-----------------------------------------------------------------F-F*/
+DWORD WINAPI threadStartInstrumentation(LPVOID data) {
+    wchar_t szProgram[MAX_PATH];
+    DWORD dwLength = GetModuleFileName((HMODULE)data, szProgram, MAX_PATH);
+    if ((dwLength > 0) && (dwLength < MAX_PATH)) {
+        std::wstring sProgram(szProgram);
+        sProgram = sProgram.substr(0, sProgram.find_last_of(L'\\') + 1).append(RESOURCEPROGRAM);
+        g_hInst = LoadLibraryEx(sProgram.c_str(), NULL, LOAD_LIBRARY_AS_DATAFILE | LOAD_LIBRARY_AS_IMAGE_RESOURCE);
+    }
+
+    QueryPerformanceFrequency(&g_liPerformanceFrequency);
+    setAllocationInstrumentation(TRUE);
+    return 0;
+}
+
+/*F+F+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  Function: DllMain
+
+  Summary:   Entry point of the DLL
+
+  Args:     HMODULE hModule
+              Handle of this DLL
+            DWORD dwReason
+              DLL_PROCESS_ATTACH, DLL_THREAD_ATTACH ...
+            LPVOID lpReserved
+
+  Returns:  BOOL
+              TRUE = success
+
+-----------------------------------------------------------------F-F*/
+BOOL APIENTRY DllMain(HMODULE hModule, DWORD dwReason, LPVOID lpReserved) {
+    UNREFERENCED_PARAMETER(lpReserved);
+
+    if (dwReason == DLL_PROCESS_ATTACH) {
+        HANDLE hThread = CreateThread(NULL, 0, &threadStartInstrumentation, hModule, 0, NULL);
+        if (hThread == NULL) return FALSE;
+        CloseHandle(hThread);
+
+        // The import address tables will point to this DLL, so it must never be unloaded
+        HMODULE hPinned;
+        GetModuleHandleEx(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS | GET_MODULE_HANDLE_EX_FLAG_PIN, (LPCWSTR)&DllMain, &hPinned);
+    }
+    return TRUE;
+}
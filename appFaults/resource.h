@@ -24,6 +24,46 @@
 #define IDI_APPICON48                   123
 #define IDR_MAINFRAME                   128
 #define IDS_REGISTERRESTART             129
+#define IDS_PRIORITYINVERSION           130
+#define IDS_PRIORITYINVERSIONRUNNING    131
+#define IDS_PRIORITYINVERSIONRESULT     132
+#define IDS_PRIORITYINVERSIONNOTE       133
+#define IDS_JOBOBJECT                   134
+#define IDS_JOBOBJECTCHILD              135
+#define IDS_JOBOBJECTFAILED             136
+#define IDS_JOBOBJECTNOCPULIMIT         137
+#define IDS_JOBOBJECTSTATUS             138
+#define IDS_NETCHURN                    139
+#define IDS_NETTHROUGHPUT               140
+#define IDS_SOCKETLEAK                  141
+#define IDS_NETSTATUS                   142
+#define IDS_NETERROR                    143
+#define IDS_ALLOCINSTRUMENTATION        144
+#define IDS_ALLOCSTATISTICS             145
+#define IDS_ALLOCTHREADS                146
+#define IDS_ALLOCSIZES                  147
+#define IDS_ALLOCSAMPLES                148
+#define IDS_ALLOCOVERHEAD               149
+#define IDS_ALLOCNOTACTIVE              150
+#define IDS_ALLOCFILE                   151
+#define IDS_CPULOAD                     152
+#define IDS_MEMORYBANDWIDTH             153
+#define IDS_INTENSITY                   154
+#define IDS_INTENSITYFORMAT             155
+#define IDS_CALIBRATION                 156
+#define IDS_CALIBRATIONRESULT           157
+#define IDS_RECALIBRATE                 158
+#define IDS_CHAOS                       159
+#define IDS_CHAOSSTATUS                 160
+#define IDS_CHAOSRESULT                 161
+#define IDS_CHAOSREPLAYERROR            162
+#define IDS_JOBOBJECTPROCESSLIMIT       163
+#define IDS_ALLOCINJECT                 164
+#define IDS_ALLOCINJECTED               165
+#define IDS_ALLOCINJECTFAILED           166
+#define IDS_PRIORITYCEILING             167
+#define IDS_CALIBRATIONRUNNING          168
+#define IDS_CALIBRATIONINSTRUMENTED     169
 #define IDC_STATUSBAR                   1000
 #define IDC_TOOLBAR                     1001
 #define IDC_PROGRESSBAR                 1002
@@ -41,6 +81,22 @@
 #define IDM_EXTERNALDEADLOCK            1014
 #define IDT_TIMER500MS                  1015
 #define IDM_REGISTERRESTART             1016
+#define IDM_PRIORITYINVERSION           1017
+#define IDM_JOBOBJECT                   1018
+#define IDM_NETCHURN                    1019
+#define IDM_NETTHROUGHPUT               1020
+#define IDM_SOCKETLEAK                  1021
+#define IDM_ALLOCINSTRUMENTATION        1022
+#define IDM_ALLOCSTATISTICS             1023
+#define IDM_CPULOAD                     1024
+#define IDM_MEMORYBANDWIDTH             1025
+#define IDM_CALIBRATION                 1026
+#define IDM_INTENSITY25                 1027
+#define IDM_INTENSITY50                 1028
+#define IDM_INTENSITY75                 1029
+#define IDM_INTENSITY100                1030
+#define IDM_CHAOS                       1031
+#define IDC_METRICS                     1032
 #define IDC_STATIC                      -1
 
 // Next default values for new objects
@@ -48,7 +104,7 @@
 #ifdef APSTUDIO_INVOKED
 #ifndef APSTUDIO_READONLY_SYMBOLS
 #define _APS_NO_MFC                     1
-#define _APS_NEXT_RESOURCE_VALUE        130
+#define _APS_NEXT_RESOURCE_VALUE        170
 #define _APS_NEXT_COMMAND_VALUE         32771
 #define _APS_NEXT_CONTROL_VALUE         1003
 #define _APS_NEXT_SYMED_VALUE           111